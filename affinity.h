@@ -0,0 +1,323 @@
+// **********************************************************
+// *
+// * Sam Young
+// * Operating Systems
+// * Programming Project 3: Process Synchronization
+// * March 14, 2025
+// * Dr. Siming Liu
+// *
+// **********************************************************
+
+#ifndef _AFFINITY_H_DEFINED_
+#define _AFFINITY_H_DEFINED_
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+#include <vector>
+#include <algorithm>
+
+/// @brief How producer and consumer threads are placed on CPUs
+enum pin_policy
+{
+    PIN_NONE,       // ? Leaves placement to the scheduler (the original behavior)
+    PIN_SPREAD,     // ? Spreads threads over as many sockets and cores as possible
+    PIN_SOCKET,     // ? Keeps every thread on one socket, one core each while cores last
+    PIN_SIBLING,    // ? Puts producer i and consumer i on the two hardware threads of one core
+    PIN_LIST        // ? Uses an explicit list of CPUs, in thread order (producers first)
+};
+
+/// @brief Where one CPU sits in the machine
+struct cpu_info
+{
+    int cpu;        // ? The CPU's number
+    int core;       // ? Its core's id (unique within its socket)
+    int socket;     // ? Its socket (physical package)
+    int node;       // ? Its NUMA node
+};
+
+/// @name affinity_read_int
+/// @brief Reads a single integer out of a sysfs file
+/// @param path The file
+/// @param fallback What to return if the file can't be read
+/// @return The integer
+int affinity_read_int(const char* path, int fallback)
+{
+    FILE* in = fopen(path, "r");
+    if (in == NULL) return fallback;
+
+    int value;
+    if (fscanf(in, "%i", &value) != 1) value = fallback;
+    fclose(in);
+    return value;
+}
+
+/// @name affinity_topology
+/// @brief Lists the CPUs this process may run on, with the core, socket and NUMA node of each (from sysfs).
+/// @brief Machines without that information are treated as one socket and one node with a core per CPU.
+/// @return The CPUs, in numerical order
+std::vector<cpu_info> affinity_topology()
+{
+    std::vector<cpu_info> cpus;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if (!CPU_ISSET(cpu, &allowed)) continue;
+
+        char path[128];
+        cpu_info info = { cpu, cpu, 0, 0 };
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%i/topology/core_id", cpu);
+        info.core = affinity_read_int(path, cpu);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%i/topology/physical_package_id", cpu);
+        info.socket = affinity_read_int(path, 0);
+
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%i", cpu);
+        DIR* dir = opendir(path);                           // ? The node shows up as a "node<N>" link in the CPU's directory
+        if (dir != NULL)
+        {
+            for (dirent* entry = readdir(dir); entry != NULL; entry = readdir(dir))
+            {
+                if (sscanf(entry->d_name, "node%i", &info.node) == 1) break;
+            }
+            closedir(dir);
+        }
+        cpus.push_back(info);
+    }
+    return cpus;
+}
+
+/// @name affinity_find
+/// @brief Looks up a CPU in a topology
+/// @param topology The CPUs from affinity_topology
+/// @param cpu The CPU's number
+/// @return The CPU's entry, or NULL if this process can't run on it
+const cpu_info* affinity_find(const std::vector<cpu_info>& topology, int cpu)
+{
+    for (const cpu_info& c : topology)
+    {
+        if (c.cpu == cpu) return &c;
+    }
+    return NULL;
+}
+
+/// @name affinity_parse
+/// @brief Reads a --pin setting: "none", "spread", "socket", "sibling", or a CPU list such as "0,2,4-7"
+/// @param text The setting
+/// @param policy Where to store the policy
+/// @param list Where to store the CPUs of a list (cleared otherwise)
+/// @return true if the setting was understood, false otherwise
+bool affinity_parse(const char* text, pin_policy* policy, std::vector<int>* list)
+{
+    list->clear();
+    if      (strcasecmp(text, "none")    == 0) *policy = PIN_NONE;
+    else if (strcasecmp(text, "spread")  == 0) *policy = PIN_SPREAD;
+    else if (strcasecmp(text, "socket")  == 0) *policy = PIN_SOCKET;
+    else if (strcasecmp(text, "sibling") == 0) *policy = PIN_SIBLING;
+    else
+    {
+        *policy = PIN_LIST;
+        while (*text != '\0')
+        {
+            char* end;
+            long first = strtol(text, &end, 10);
+            if (end == text || first < 0 || first >= CPU_SETSIZE) return false;
+
+            long last = first;
+            if (*end == '-')                                // ? A range, e.g. "4-7"
+            {
+                text = end + 1;
+                last = strtol(text, &end, 10);
+                if (end == text || last < first || last >= CPU_SETSIZE) return false;
+            }
+            for (long cpu = first; cpu <= last; ++cpu) list->push_back((int)cpu);
+
+            if (*end == ',') ++end;
+            else if (*end != '\0') return false;
+            text = end;
+        }
+        if (list->empty()) return false;
+    }
+    return true;
+}
+
+/// @name affinity_plan
+/// @brief Picks a CPU for every thread. Threads are numbered like the stats slots: producers 0..P-1, then consumers.
+/// @brief When there are more threads than CPUs, the choices wrap around.
+/// @param policy The placement policy
+/// @param list The CPUs for PIN_LIST
+/// @param topology The CPUs from affinity_topology
+/// @param producers The number of producer threads
+/// @param consumers The number of consumer threads
+/// @param out Where to store each thread's CPU (-1 for unpinned)
+/// @return true on success, false if the list names a CPU this process can't run on
+bool affinity_plan(pin_policy policy, const std::vector<int>& list, const std::vector<cpu_info>& topology,
+                   int producers, int consumers, std::vector<int>* out)
+{
+    int threads = producers + consumers;
+    out->assign(threads, -1);
+    if (policy == PIN_NONE || topology.empty()) return true;
+
+    if (policy == PIN_LIST)
+    {
+        for (int cpu : list)
+        {
+            if (affinity_find(topology, cpu) == NULL) return false;
+        }
+        for (int t = 0; t < threads; ++t) (*out)[t] = list[t % list.size()];
+        return true;
+    }
+
+    // ? Numbers each CPU within its core (0 for the first hardware thread, 1 for its sibling, ...) and each core within
+    // ? its socket, so the orders below can be written as sorts
+    struct ranked { cpu_info info; int smt; int core_rank; };
+    std::vector<ranked> cpus;
+    std::vector<std::pair<int, int>> cores;                 // ? Every (socket, core) seen so far, in order
+    for (const cpu_info& c : topology)
+    {
+        ranked r = { c, 0, 0 };
+        for (const ranked& seen : cpus)
+        {
+            if (seen.info.socket == c.socket && seen.info.core == c.core) ++r.smt;
+        }
+        std::pair<int, int> key(c.socket, c.core);
+        if (std::find(cores.begin(), cores.end(), key) == cores.end()) cores.push_back(key);
+        for (const std::pair<int, int>& k : cores)
+        {
+            if (k == key) break;
+            if (k.first == c.socket) ++r.core_rank;
+        }
+        cpus.push_back(r);
+    }
+
+    if (policy == PIN_SIBLING)                              // ? Core by core, first hardware thread then its sibling
+    {
+        std::stable_sort(cpus.begin(), cpus.end(), [](const ranked& a, const ranked& b) {
+            if (a.info.socket != b.info.socket) return a.info.socket < b.info.socket;
+            if (a.core_rank != b.core_rank) return a.core_rank < b.core_rank;
+            return a.smt < b.smt;
+        });
+        std::vector<std::vector<int>> cores;                // ? The hardware threads of each core, in that order
+        for (size_t i = 0; i < cpus.size(); ++i)
+        {
+            if (i == 0 || cpus[i].info.core != cpus[i - 1].info.core || cpus[i].info.socket != cpus[i - 1].info.socket)
+            {
+                cores.push_back({});
+            }
+            cores.back().push_back(cpus[i].info.cpu);
+        }
+
+        int pairs = std::max(producers, consumers);
+        for (int i = 0; i < pairs; ++i)
+        {
+            const std::vector<int>& core = cores[i % cores.size()];
+            if (i < producers) (*out)[i] = core[0];
+            if (i < consumers) (*out)[producers + i] = core[core.size() > 1 ? 1 : 0];
+        }
+        return true;
+    }
+
+    if (policy == PIN_SOCKET)                               // ? Only the first socket, every core before any sibling
+    {
+        int socket = cpus[0].info.socket;
+        cpus.erase(std::remove_if(cpus.begin(), cpus.end(), [socket](const ranked& r) { return r.info.socket != socket; }),
+                   cpus.end());
+        std::stable_sort(cpus.begin(), cpus.end(), [](const ranked& a, const ranked& b) {
+            if (a.smt != b.smt) return a.smt < b.smt;
+            return a.core_rank < b.core_rank;
+        });
+    }
+    else                                                    // ? Spread: alternate sockets, every core before any sibling
+    {
+        std::stable_sort(cpus.begin(), cpus.end(), [](const ranked& a, const ranked& b) {
+            if (a.smt != b.smt) return a.smt < b.smt;
+            if (a.core_rank != b.core_rank) return a.core_rank < b.core_rank;
+            return a.info.socket < b.info.socket;
+        });
+    }
+
+    // ? Producer i and consumer i take neighboring entries, so a pair shares a socket under "socket" and sits on
+    // ? different sockets under "spread" whenever the machine has more than one
+    int paired = std::min(producers, consumers);
+    for (int t = 0; t < threads; ++t)
+    {
+        int order;
+        if (t < producers) order = (t < paired) ? 2 * t : paired + t;   // ? Unpaired threads follow the pairs
+        else order = (t - producers < paired) ? 2 * (t - producers) + 1 : paired + (t - producers);
+        (*out)[t] = cpus[order % cpus.size()].info.cpu;
+    }
+    return true;
+}
+
+/// @name affinity_set
+/// @brief Sets the CPU a pthread_attr_t's thread will be created on
+/// @param attr The attributes
+/// @param cpu The CPU, or -1 to let the thread run anywhere this process may
+void affinity_set(pthread_attr_t* attr, int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (cpu < 0) sched_getaffinity(0, sizeof(set), &set);
+    else CPU_SET(cpu, &set);
+    pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+}
+
+/// @name affinity_pin_self
+/// @brief Moves the calling thread onto one CPU, e.g. so memory it touches first lands on that CPU's NUMA node
+/// @param cpu The CPU
+/// @param saved Where to store the thread's previous CPU set, for affinity_restore_self
+void affinity_pin_self(int cpu, cpu_set_t* saved)
+{
+    pthread_getaffinity_np(pthread_self(), sizeof(*saved), saved);
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/// @name affinity_restore_self
+/// @brief Lets the calling thread run on the CPUs it could before affinity_pin_self
+/// @param saved The CPU set affinity_pin_self saved
+void affinity_restore_self(const cpu_set_t* saved)
+{
+    pthread_setaffinity_np(pthread_self(), sizeof(*saved), saved);
+}
+
+/// @name affinity_node_of
+/// @brief Asks the kernel which NUMA node a page of memory lives on
+/// @param addr Any address in the page (the page must already have been touched)
+/// @return The node, or -1 if the kernel can't say (e.g. no NUMA support)
+int affinity_node_of(const void* addr)
+{
+    int node = -1;
+    if (syscall(SYS_get_mempolicy, &node, NULL, 0, addr, MPOL_F_NODE | MPOL_F_ADDR) != 0) return -1;
+    return node;
+}
+
+/// @name pin_policy_name
+/// @brief Gets the name the command line uses for a placement policy
+/// @param p The policy
+/// @return Its name
+const char* pin_policy_name(pin_policy p)
+{
+    switch (p)
+    {
+        case PIN_SPREAD:    return "spread";
+        case PIN_SOCKET:    return "socket";
+        case PIN_SIBLING:   return "sibling";
+        case PIN_LIST:      return "list";
+        default:            return "none";
+    }
+}
+
+#endif // _AFFINITY_H_DEFINED_
@@ -11,244 +11,782 @@
 #ifndef _BUFFER_H_DEFINED_
 #define _BUFFER_H_DEFINED_
 
-#define BUFFER_SIZE 5
+#define DEFAULT_BUFFER_SIZE 5
 
 #include <semaphore.h>
-#include <unordered_map>
-
-typedef int buffer_item;
-
-buffer_item         buffer[BUFFER_SIZE];    // ? The buffer
-pthread_mutex_t     mutex;                  // ? The mutex
-pthread_mutex_t     print_mutex;            // ? A mutex so printing doesn't overlap (Unlikely, but could happen)
-sem_t               empty, full;            // ? Two semaphores, empty representing empty slots and full representing full slots
-int                 count;                  // ? The count of the number of items currently in the buffer
-int                 head;                   // ? An integer representing where the current index for reading is
-int                 tail;                   // ? An integer representing where the current index for writing is
-int                 produced_count;         // ? An integer representing how many items have been produced
-int                 consumed_count;         // ? An integer representing how many items have been consumed
-int                 full_count;             // ? An integer representing how many times the buffer has been full
-int                 empty_count;            // ? An integer representing how many times the buffer has been empty
-
-extern std::unordered_map<pid_t, int> produced_counts;  // ? A map for storing each thread's produced items count (from project3.cpp)
-extern std::unordered_map<pid_t, int> consumed_counts;  // ? A map for storing each thread's consumed items count (from project3.cpp)
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "log.h"
+#include "stats.h"
+#include "queue.h"
+#include "shm.h"
+#include "prime.h"
+#include "rng.h"
+
+typedef int64_t buffer_item;    // ? 64 bits, so a benchmark item can carry a whole steady-clock time in nanoseconds
+
+/// @brief One shard's counters (sharded mode), or one class's (priority mode). Each gets its own cache line, so
+/// @brief they never share one.
+struct alignas(CACHE_LINE_SIZE) buffer_shard_counts
+{
+    std::atomic<long>   inserted;   // ? Items producers put in this shard or class
+    std::atomic<long>   removed;    // ? Items consumers took out of it (stolen or not, for a shard)
+};
+
+bounded_queue<buffer_item>* buffer_queue = NULL;   // ? The buffer, created by buffer_initialize (the first shard in sharded mode)
+int                 buffer_size;            // ? The buffer's capacity, chosen at startup (each shard's, in sharded mode)
+buffer_engine       engine;                 // ? The engine selected at startup
+pthread_mutex_t     print_mutex;            // ? A mutex so direct calls to buffer_print don't overlap
+
+bounded_queue<buffer_item>** buffer_shards = NULL;  // ? Sharded mode's sub-queues (NULL with one shared buffer)
+int                 buffer_shard_count = 0;         // ? How many shards there are (0 with one shared buffer)
+buffer_shard_counts* buffer_shard_totals = NULL;    // ? Each shard's counters
+wait_policy         buffer_wait = WAIT_ADAPTIVE;    // ? How sharded (or priority) consumers wait while every shard (or class) is empty
+padded_futex        buffer_idle;                    // ? Where they park meanwhile
+std::atomic<bool>   buffer_closed(false);           // ? Set once every shard (or class) has been closed
+shm_ring<buffer_item>* buffer_shm = NULL;           // ? Shared-memory mode's ring, which other processes attach to too (NULL otherwise)
+
+bounded_queue<buffer_item>** buffer_classes = NULL; // ? Priority mode's per-class queues, most urgent first (NULL otherwise)
+int                 buffer_class_count = 0;         // ? How many classes there are (0 without priority mode)
+buffer_shard_counts* buffer_class_totals = NULL;    // ? Each class's counters
+bool                buffer_class_strict = true;     // ? Whether consumers always take the most urgent class first, or share by weight
+std::vector<int>    buffer_class_weights;           // ? In weighted mode, how many removes each class gets per turn
+std::vector<int>    buffer_class_mix;               // ? How often producers pick each class, relative to the others
+int                 buffer_class_mix_total = 0;     // ? The sum of buffer_class_mix
+thread_local int    buffer_class_turn = 0;          // ? In weighted mode, the class this consumer is serving
+thread_local int    buffer_class_served = 0;        // ? And how many removes it has served from it this turn
+
 extern bool buff_snap;                                  // ? Handles buffer snapshot (from project3.cpp)
 
-/// @name prime
-/// @brief This function detects whether a provided number is prime or not
-/// @param n The number to detect
-/// @return true if the number is prime, false otherwise
-bool prime(int n)
+/// @name buffer_count
+/// @brief Gets the number of items currently in the buffer (every shard's or class's, in sharded or priority mode),
+/// @brief whichever engine is running. Never takes a lock.
+/// @return The buffer's occupancy
+/// @note This function uses the following global variables:
+/// @note - buffer_queue, buffer_shm (from buffer.h): The buffer
+/// @note - buffer_shards, buffer_shard_count (from buffer.h): The shards
+/// @note - buffer_classes, buffer_class_count (from buffer.h): The classes
+int buffer_count()
 {
-    if (n <= 1)     // ? If the number is 0 or 1, it's not prime. Return false
+    if (buffer_shm != NULL) return buffer_shm->size();
+    if (buffer_class_count > 0)
     {
-        return false;
+        int total = 0;
+        for (int c = 0; c < buffer_class_count; ++c) total += buffer_classes[c]->size();
+        return total;
     }
-    else            // ? Otherwise, we iterate through numbers until n. If we find a number that evenly divides n, it's not prime, and we return false
+    if (buffer_shard_count == 0) return buffer_queue->size();
+
+    int total = 0;
+    for (int i = 0; i < buffer_shard_count; ++i) total += buffer_shards[i]->size();
+    return total;
+}
+
+/// @name buffer_capacity
+/// @brief Gets how many items the buffer can hold in all (every shard's or class's capacity, in sharded or priority
+/// @brief mode)
+/// @return The capacity
+/// @note This function uses the following global variables:
+/// @note - buffer_size, buffer_shard_count, buffer_shm (from buffer.h): The buffer's shape
+/// @note - buffer_classes, buffer_class_count (from buffer.h): The classes
+int buffer_capacity()
+{
+    if (buffer_shm != NULL) return buffer_shm->capacity();
+    if (buffer_class_count > 0)
     {
-        for (int i = 2; i < n; ++i)
-        {
-            if (n % i == 0)
-            {
-                return 0;
-            }
-        }
-        return 1;   // ? If it doesn't find a number, return true
+        int total = 0;
+        for (int c = 0; c < buffer_class_count; ++c) total += buffer_classes[c]->capacity();
+        return total;
     }
+    return buffer_shard_count == 0 ? buffer_size : buffer_size * buffer_shard_count;
 }
 
-/// @brief Prints out the contents of the buffer
+/// @name buffer_parked_producers
+/// @brief Gets how many producers are blocked waiting for room
+/// @return The number of threads
+/// @note This function uses the following global variables:
+/// @note - buffer_queue, buffer_shards, buffer_shard_count, buffer_shm (from buffer.h): The buffer
+/// @note - buffer_classes, buffer_class_count (from buffer.h): The classes
+int buffer_parked_producers()
+{
+    if (buffer_shm != NULL) return buffer_shm->parked_producers();
+    if (buffer_class_count > 0)
+    {
+        int total = 0;
+        for (int c = 0; c < buffer_class_count; ++c) total += buffer_classes[c]->parked_producers();
+        return total;
+    }
+    if (buffer_shard_count == 0) return buffer_queue->parked_producers();
+
+    int total = 0;
+    for (int i = 0; i < buffer_shard_count; ++i) total += buffer_shards[i]->parked_producers();
+    return total;
+}
+
+/// @name buffer_parked_consumers
+/// @brief Gets how many consumers are blocked waiting for items
+/// @return The number of threads
+/// @note This function uses the following global variables:
+/// @note - buffer_queue, buffer_shm (from buffer.h): The buffer
+/// @note - buffer_shard_count, buffer_class_count, buffer_idle (from buffer.h): Where sharded or priority consumers park
+int buffer_parked_consumers()
+{
+    if (buffer_shm != NULL) return buffer_shm->parked_consumers();
+    if (buffer_shard_count == 0 && buffer_class_count == 0) return buffer_queue->parked_consumers();
+    return buffer_idle.waiters.load(std::memory_order_relaxed);
+}
+
+/// @name buffer_snapshot_of
+/// @brief Copies one queue's (or ring's) state for a snapshot
+/// @param queue The queue
+/// @param snap Where to store the copy
+/// @param copy_items Whether to copy the slots' contents too. Only safe while no other thread can write them:
+/// @param copy_items under the mutex engine's lock, or while the buffer is idle.
+template <typename Queue>
+void buffer_snapshot_of(const Queue* queue, log_snapshot* snap, bool copy_items)
+{
+    snap->occupancy = queue->size();
+    snap->capacity = queue->capacity();
+    snap->head = queue->read_slot();
+    snap->tail = queue->write_slot();
+    snap->shown = (snap->capacity > LOG_SNAPSHOT_MAX) ? LOG_SNAPSHOT_MAX : snap->capacity;
+    snap->copied = copy_items;
+    for (int i = 0; copy_items && i < snap->shown; ++i)
+    {
+        snap->items[i] = (int)queue->at(i);                 // ? Items are drawn from item_range, which fits an int
+    }
+}
+
+/// @name buffer_holds_lock
+/// @brief Gets whether a hook running on a queue holds a lock that keeps every other thread off its slots. Only the
+/// @brief mutex engine's does; the lock-free engines' (and the shared ring's) slots are written concurrently.
+/// @param queue The queue the hook runs on
+/// @return true if the slots can be read safely
+inline bool buffer_holds_lock(const bounded_queue<buffer_item>* queue) { return queue->engine() == ENGINE_MUTEX; }
+inline bool buffer_holds_lock(const shm_ring<buffer_item>*) { return false; }
+
+/// @name buffer_take_snapshot
+/// @brief Copies the buffer's state, slots and all, so it can be drawn. Only call it while no thread is using the
+/// @brief buffer (e.g. right after buffer_initialize); worker threads log snapshots with buffer_log_snapshot.
+/// @brief In sharded mode this is the first shard, and in priority mode the most urgent class.
+/// @param snap Where to store the copy
+/// @note This function uses the following global variables:
+/// @note - buffer_queue, buffer_shm (from buffer.h): The buffer
+void buffer_take_snapshot(log_snapshot* snap)
+{
+    if (buffer_shm != NULL) buffer_snapshot_of(buffer_shm, snap, true);
+    else                    buffer_snapshot_of(buffer_queue, snap, true);
+}
+
+/// @name buffer_memory
+/// @brief Gets the address of the buffer's first slot, e.g. to ask which NUMA node it landed on
+/// @return The address
+/// @note This function uses the following global variables:
+/// @note - buffer_queue, buffer_shm (from buffer.h): The buffer
+const void* buffer_memory()
+{
+    if (buffer_shm != NULL) return &buffer_shm->at(0);
+    return &buffer_queue->at(0);
+}
+
+/// @name buffer_log_snapshot
+/// @brief Hands a snapshot of the queue (shard, class or shared ring) a hook is running on to the logging pipeline, if
+/// @brief the user asked for snapshots. Only the first LOG_SNAPSHOT_MAX slots are copied, so this is cheap enough to
+/// @brief do inside the critical section, and only when the hook holds the queue's lock; otherwise just the
+/// @brief occupancy and read/write slots are recorded.
+/// @param queue The queue
+/// @note This function uses the following global variables:
+/// @note - buff_snap (from project3.cpp): Whether the user wants buffer snapshots displayed
+template <typename Queue>
+inline void buffer_log_snapshot(const Queue* queue)
+{
+    if (!buff_snap) return;
+
+    log_snapshot snap;
+    buffer_snapshot_of(queue, &snap, buffer_holds_lock(queue));
+    log_record_snapshot(snap);
+}
+
+/// @brief Prints out the contents of the buffer right away. Large buffers only have their first LOG_SNAPSHOT_MAX
+/// @brief slots drawn. Worker threads log snapshots with buffer_log_snapshot instead.
 /// @param num Defaults to -1. If a number other is sent, checks if it's prime and outputs whether it is.
 /// @note This function uses the following global variables:
-/// @note - BUFFER_SIZE (from buffer.h): The buffer's size
 /// @note - print_mutex (from buffer.h): A mutex so printing doesn't overlap
-/// @note - buffer[i] (from buffer.h): The buffer
-/// @note - head (from buffer.h): An integer representing where the current index for reading is
-/// @note - tail (from buffer.h): An integer representing where the current index for writing is
 void buffer_print(int num = -1)
 {
+    log_snapshot snap;
+    std::string text;
+
+    buffer_take_snapshot(&snap);
+    log_format_snapshot(text, snap, num != -1 && prime_is(num));
+
     pthread_mutex_lock(&print_mutex);
-    printf("(buffers occupied %i)", count);
-    
-    if (num != -1)
+    fwrite(text.data(), 1, text.size(), stdout);
+    pthread_mutex_unlock(&print_mutex);
+}
+
+/// @name buffer_log_wait
+/// @brief Logs that the calling thread found the buffer full or empty and has to wait (the queue's on_wait callback)
+/// @param is_full true if the buffer was full, false if it was empty
+/// @param capacity The capacity of the queue that was full (each shard's, class's or the shared ring's own)
+void buffer_log_wait(bool is_full, int capacity)
+{
+    if (is_full) log_record(LOG_FULL_WAIT, 0, capacity);
+    else         log_record(LOG_EMPTY_WAIT, 0, 0);
+}
+
+/// @brief The bookkeeping done for every span written to the buffer, while it's still private to the writer:
+/// @brief logs each item, logs a snapshot, and counts the items (and whether they left the buffer full)
+template <typename Queue = bounded_queue<buffer_item>>
+struct buffer_insert_hook
+{
+    Queue*  queue;      // ? The queue, shard or shared ring being written
+
+    void operator()(size_t pos, int n, int occupancy) const
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            log_record(LOG_WRITE, queue->at(pos + i), occupancy);  // ? Logs success (the writer thread does the printing)
+        }
+        buffer_log_snapshot(queue);                             // ? Logs its status
+        stat_add(my_stats->produced, n);                        // ? Increments this thread's count of produced items
+        if (occupancy == queue->capacity()) stat_add(my_stats->full, 1);    // ? If the buffer is full, increments the count of times the buffer has been full
+    }
+};
+
+/// @brief The bookkeeping done for every span read from the buffer, before its slots are handed back
+template <typename Queue = bounded_queue<buffer_item>>
+struct buffer_remove_hook
+{
+    Queue*  queue;      // ? The queue, shard or shared ring being read
+
+    void operator()(size_t pos, int n, int occupancy) const
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            log_record(LOG_READ, queue->at(pos + i), occupancy);
+        }
+        buffer_log_snapshot(queue);
+        stat_add(my_stats->consumed, n);                        // ? Increments the thread's count of how many times it has eaten an item
+        if (occupancy == 0) stat_add(my_stats->empty, 1);       // ? If the buffer is now empty, increments the number of times the buffer has been empty
+    }
+};
+
+/// @name buffer_initialize
+/// @brief Initializes the buffer, replacing any buffer from an earlier run
+/// @param selected The engine to run the buffer with. Defaults to the semaphore + mutex baseline.
+/// @param capacity The number of slots to allocate. Defaults to DEFAULT_BUFFER_SIZE.
+/// @param policy How threads wait while the buffer is full or empty. Defaults to spinning, then yielding, then parking.
+/// @param shards How many sub-queues of capacity slots each to split the buffer into. Defaults to 0, which keeps one
+/// @param shards buffer shared by every thread.
+/// @param classes Each priority class's capacity, most urgent first. Defaults to none; otherwise the buffer is one
+/// @param classes queue per class, and capacity and shards are ignored.
+/// @note This function uses the following global variables:
+/// @note - print_mutex (from buffer.h): A mutex so printing doesn't overlap
+/// @note - buff_snap (from project3.cpp): Whether the user wants buffer snapshots displayes
+/// @note - buffer_queue (from buffer.h): The buffer
+/// @note - buffer_size (from buffer.h): The buffer's capacity
+/// @note - engine (from buffer.h): The engine selected at startup
+/// @note - buffer_shards, buffer_shard_count, buffer_shard_totals, buffer_wait, buffer_idle, buffer_closed (from buffer.h): Sharded mode's state
+/// @note - buffer_classes, buffer_class_count, buffer_class_totals (from buffer.h): Priority mode's state
+void buffer_initialize(buffer_engine selected = ENGINE_MUTEX, int capacity = DEFAULT_BUFFER_SIZE, wait_policy policy = WAIT_ADAPTIVE, int shards = 0,
+                       const std::vector<int>& classes = std::vector<int>())
+{
+    engine = selected;
+    buffer_size = capacity;
+
+    if (buffer_queue != NULL)                               // ? Tears down any earlier run before setting up again
+    {
+        pthread_mutex_destroy(&print_mutex);
+    }
+    if (buffer_shard_count > 0)
     {
-        if (prime(num))
+        for (int i = 0; i < buffer_shard_count; ++i) delete buffer_shards[i];   // ? buffer_queue is the first of these
+        delete[] buffer_shards;
+        delete[] buffer_shard_totals;
+        buffer_shards = NULL;
+        buffer_shard_totals = NULL;
+    }
+    else if (buffer_class_count > 0)
+    {
+        for (int c = 0; c < buffer_class_count; ++c) delete buffer_classes[c];  // ? buffer_queue is the first of these
+        delete[] buffer_classes;
+        delete[] buffer_class_totals;
+        buffer_classes = NULL;
+        buffer_class_totals = NULL;
+    }
+    else
+    {
+        delete buffer_queue;
+    }
+
+    if (!classes.empty()) shards = 0;
+    buffer_shard_count = shards;
+    buffer_class_count = (int)classes.size();
+    buffer_wait = policy;
+    buffer_idle.epoch.store(0, std::memory_order_relaxed);
+    buffer_idle.waiters.store(0, std::memory_order_relaxed);
+    buffer_closed.store(false, std::memory_order_relaxed);
+    if (shards > 0)
+    {
+        buffer_shards = new bounded_queue<buffer_item>*[shards];
+        buffer_shard_totals = new buffer_shard_counts[shards];
+        for (int i = 0; i < shards; ++i)
         {
-            printf("\t* * * PRIME * * *");
+            buffer_shards[i] = new bounded_queue<buffer_item>(selected, capacity, policy);
+            buffer_shards[i]->fill(-1);
+            buffer_shards[i]->on_wait = buffer_log_wait;
+            buffer_shard_totals[i].inserted.store(0, std::memory_order_relaxed);
+            buffer_shard_totals[i].removed.store(0, std::memory_order_relaxed);
         }
+        buffer_queue = buffer_shards[0];
+    }
+    else if (buffer_class_count > 0)
+    {
+        buffer_classes = new bounded_queue<buffer_item>*[buffer_class_count];
+        buffer_class_totals = new buffer_shard_counts[buffer_class_count];
+        for (int c = 0; c < buffer_class_count; ++c)
+        {
+            buffer_classes[c] = new bounded_queue<buffer_item>(selected, classes[c], policy);
+            buffer_classes[c]->fill(-1);
+            buffer_classes[c]->on_wait = buffer_log_wait;
+            buffer_class_totals[c].inserted.store(0, std::memory_order_relaxed);
+            buffer_class_totals[c].removed.store(0, std::memory_order_relaxed);
+        }
+        buffer_queue = buffer_classes[0];
+    }
+    else
+    {
+        buffer_queue = new bounded_queue<buffer_item>(selected, capacity, policy);
+        buffer_queue->fill(-1);
+        buffer_queue->on_wait = buffer_log_wait;
     }
-    
-    printf("\n");
-    printf("buffers: ");
-    
-    for (int i = 0; i < BUFFER_SIZE; ++i)
+
+    pthread_mutex_init(&print_mutex, NULL);
+    if (buff_snap) buffer_print();
+}
+
+/// @name buffer_close
+/// @brief Closes the buffer: every later insert fails, and every thread blocked on the buffer wakes up.
+/// @brief Removes keep working until whatever is left has been taken.
+/// @note This function uses the following global variables:
+/// @note - buffer_queue (from buffer.h): The buffer
+/// @note - buffer_shards, buffer_shard_count, buffer_idle, buffer_closed (from buffer.h): Sharded mode's state
+/// @note - buffer_classes, buffer_class_count (from buffer.h): Priority mode's classes
+/// @note - buffer_shm (from buffer.h): Shared-memory mode's ring
+void buffer_close()
+{
+    if (buffer_shm != NULL)
     {
-        printf("%*i", 5, buffer[i]);
+        buffer_shm->close();
+        return;
     }
-    
-    printf("\n\t  ");
-    
-    for (int i = 0; i < BUFFER_SIZE; ++i)
+    if (buffer_shard_count == 0 && buffer_class_count == 0)
     {
-        printf("---- ");
+        buffer_queue->close();
+        return;
     }
-    
-    printf("\n\t  ");
-    
-    for(int i = 0; i < BUFFER_SIZE; ++i)
+
+    for (int i = 0; i < buffer_shard_count; ++i) buffer_shards[i]->close();
+    for (int c = 0; c < buffer_class_count; ++c) buffer_classes[c]->close();
+    buffer_closed.store(true, std::memory_order_seq_cst);
+    buffer_idle.epoch.fetch_add(1, std::memory_order_release);     // ? Wakes every parked consumer, whatever the policy
+    queue_futex_wake(&buffer_idle.epoch, INT_MAX);
+}
+
+/// @name buffer_stop
+/// @brief Makes the consumers give up right away instead of draining what's left. Only shared-memory mode needs it:
+/// @brief there, closing only ends this process's inserts, and other processes may keep the ring going.
+/// @note This function uses the following global variables:
+/// @note - buffer_shm (from buffer.h): Shared-memory mode's ring
+void buffer_stop()
+{
+    if (buffer_shm != NULL) buffer_shm->stop();
+}
+
+/// @name buffer_attach_shm
+/// @brief Switches the buffer to a ring in a POSIX shared memory segment, creating the segment if no other process
+/// @brief has yet. Call it once, before any run; the segment's own capacity wins over the one asked for.
+/// @param name The segment's name (e.g. "/osproj4")
+/// @param capacity The number of slots, if this process creates the segment
+/// @param policy How this process's threads wait while the ring is full or empty
+/// @param producing Whether this process runs producers (the ring closes once every producing process is done)
+/// @param error Where to describe what went wrong, on failure
+/// @return true on success, false otherwise
+/// @note This function uses the following global variables:
+/// @note - buffer_shm, buffer_size, engine, print_mutex (from buffer.h): The buffer
+bool buffer_attach_shm(const char* name, int capacity, wait_policy policy, bool producing, std::string* error)
+{
+    buffer_shm = shm_ring<buffer_item>::attach(name, capacity, policy, producing, error);
+    if (buffer_shm == NULL) return false;
+
+    buffer_shm->on_wait = buffer_log_wait;
+    buffer_size = buffer_shm->capacity();
+    engine = ENGINE_MPMC;                                   // ? The ring runs the MPMC engine's algorithm
+    pthread_mutex_init(&print_mutex, NULL);
+    return true;
+}
+
+/// @name buffer_detach_shm
+/// @brief Detaches from the shared memory segment (the segment itself stays for other processes)
+/// @note This function uses the following global variables:
+/// @note - buffer_shm (from buffer.h): Shared-memory mode's ring
+void buffer_detach_shm()
+{
+    delete buffer_shm;
+    buffer_shm = NULL;
+}
+
+/// @name buffer_home_shard
+/// @brief Gets the calling thread's own shard: producer i and consumer i both call shard i % shards home
+/// @return The shard's index
+/// @note This function uses the following global variables:
+/// @note - my_stats (from stats.h): The calling thread's slot, which knows its number within its role
+/// @note - buffer_shard_count (from buffer.h): How many shards there are
+inline int buffer_home_shard()
+{
+    int index = my_stats->index > 0 ? my_stats->index - 1 : 0;
+    return index % buffer_shard_count;
+}
+
+/// @name buffer_wake_idle
+/// @brief Wakes one consumer parked because every shard (or class) was empty, if there is one (called after inserting)
+/// @note This function uses the following global variables:
+/// @note - buffer_wait, buffer_idle (from buffer.h): How consumers wait, and where they park
+inline void buffer_wake_idle()
+{
+    if (buffer_wait == WAIT_SPIN) return;                   // ? Nobody ever parks
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);    // ? Pairs with the consumer's: either it sees our items, or we see it
+    if (buffer_idle.waiters.load(std::memory_order_relaxed) == 0) return;
+
+    buffer_idle.epoch.fetch_add(1, std::memory_order_release);
+    queue_futex_wake(&buffer_idle.epoch, 1);
+}
+
+/// @name buffer_shard_insert
+/// @brief Inserts a span of items into the calling thread's home shard, blocking while that shard is full
+/// @param items The items to insert
+/// @param n How many items to insert
+/// @return The number of items inserted (fewer than n only if the buffer was closed)
+/// @note This function uses the following global variables:
+/// @note - buffer_shards, buffer_shard_totals (from buffer.h): The shards and their counters
+int buffer_shard_insert( const buffer_item* items, int n )
+{
+    int home = buffer_home_shard();
+    bounded_queue<buffer_item>* shard = buffer_shards[home];
+    int done = shard->push_n(items, n, buffer_insert_hook<>{ shard });
+    buffer_shard_totals[home].inserted.fetch_add(done, std::memory_order_relaxed);
+    if (done > 0) buffer_wake_idle();
+    return done;
+}
+
+/// @name buffer_shard_try_remove
+/// @brief Takes up to max_n items from the first shard that has any, starting with the calling thread's home shard
+/// @brief and then stealing from the others in turn. Never waits.
+/// @param items Where to store the removed items
+/// @param max_n The most items to remove
+/// @return The number of items removed (0 if every shard looked empty)
+/// @note This function uses the following global variables:
+/// @note - buffer_shards, buffer_shard_count, buffer_shard_totals (from buffer.h): The shards and their counters
+/// @note - my_stats (from stats.h): This thread's counters
+int buffer_shard_try_remove( buffer_item* items, int max_n )
+{
+    int home = buffer_home_shard();
+    for (int i = 0; i < buffer_shard_count; ++i)
     {
-        if (i == head && i == tail)
+        int s = (home + i) % buffer_shard_count;
+        bounded_queue<buffer_item>* shard = buffer_shards[s];
+        if (i > 0 && shard->size() == 0) continue;          // ? Only touches another shard's lock or indices if it has items
+
+        int n = shard->try_pop_n(items, max_n, buffer_remove_hook<>{ shard });
+        if (n > 0)
         {
-            printf(" RW ");
+            buffer_shard_totals[s].removed.fetch_add(n, std::memory_order_relaxed);
+            if (i > 0) stat_add(my_stats->steals, 1);
+            return n;
         }
-        else if (i == head)
+    }
+    return 0;
+}
+
+/// @name buffer_idle_remove
+/// @brief Removes up to max_n items from a set of queues (the shards, or the classes), blocking while every one is
+/// @brief empty. Waits follow the wait policy: spin, then yield, then park until a producer inserts something or the
+/// @brief buffer is closed.
+/// @param queues The queues
+/// @param count How many queues there are
+/// @param try_remove Takes items from whichever queue the mode prefers without waiting, returning how many (0 if
+/// @param try_remove every queue looked empty)
+/// @return The number of items removed (0 only once the buffer is closed and every queue is empty)
+/// @note This function uses the following global variables:
+/// @note - buffer_wait, buffer_idle, buffer_closed (from buffer.h): How consumers wait, and where they park
+template <typename TryRemove>
+int buffer_idle_remove( bounded_queue<buffer_item>** queues, int count, TryRemove try_remove )
+{
+    unsigned spins = 0;
+    bool waited = false;
+    for (;;)
+    {
+        bool closing = buffer_closed.load(std::memory_order_acquire);  // ? Read first, so items inserted before the close are still found
+        int n = try_remove();
+        if (n > 0) return n;
+        if (closing) return 0;
+
+        if (!waited)
         {
-            printf(" R  ");
+            buffer_log_wait(false, 0);
+            waited = true;
         }
-        else if (i == tail)
+        ++spins;
+        if (buffer_wait == WAIT_SPIN || (buffer_wait == WAIT_ADAPTIVE && spins < QUEUE_SPIN_LIMIT))
         {
-            printf("  W ");
+            cpu_relax();
+            continue;
         }
-        else
+        if (buffer_wait == WAIT_ADAPTIVE && spins < QUEUE_SPIN_LIMIT + QUEUE_YIELD_LIMIT)
         {
-            printf("    ");
+            sched_yield();
+            continue;
         }
-        printf(" ");
+
+        int epoch = buffer_idle.epoch.load(std::memory_order_acquire);
+        buffer_idle.waiters.fetch_add(1, std::memory_order_seq_cst);
+        bool ready = buffer_closed.load(std::memory_order_acquire);
+        for (int i = 0; i < count && !ready; ++i) ready = queues[i]->size() > 0;
+        if (!ready) queue_futex_wait(&buffer_idle.epoch, epoch);
+        buffer_idle.waiters.fetch_sub(1, std::memory_order_relaxed);
     }
-    
-    printf("\n");
-    pthread_mutex_unlock(&print_mutex);
 }
 
-/// @name buffer_initialize
-/// @brief Initializes the buffer
+/// @name buffer_shard_remove
+/// @brief Removes up to max_n items from the shards, blocking while every shard is empty
+/// @param items Where to store the removed items
+/// @param max_n The most items to remove
+/// @return The number of items removed (0 only once the buffer is closed and every shard is empty)
 /// @note This function uses the following global variables:
-/// @note - produced_count (from buffer.h): A count of how many items have been produced
-/// @note - consumed_count (from buffer.h): A count of how many items have been read
-/// @note - print_mutex (from buffer.h): A mutex so printing doesn't overlap
-/// @note - empty_count (from buffer.h): A count of how many times the buffer has been empty
-/// @note - full_count (from buffer.h): A count of how many times the buffer has been full
-/// @note - buff_snap (from project3.cpp): Whether the user wants buffer snapshots displayes
-/// @note - buffer (from buffer.h): The buffer
-/// @note - mutex (from buffer.h): The mutex
-/// @note - empty (from buffer.h): A semaphore representing the number of empty slots
-/// @note - count (from buffer.h): The count of how many items are in the buffer
-/// @note - full (from buffer.h): A semaphore representing the number of full slots
-/// @note - head (from buffer.h): The current index for writing
-/// @note - tail (from buffer.h): The current index for reading
-void buffer_initialize()
-{
-    pthread_mutex_init(&mutex, NULL);
-    pthread_mutex_init(&print_mutex, NULL);
-    sem_init(&empty, 0, BUFFER_SIZE);
-    sem_init(&full, 0, 0);
-    for (int i = 0; i < BUFFER_SIZE; ++i)
-    {
-        buffer[i] = -1;
-    }
-    count = 0;
-    head = 0;
-    tail = 0;
-    produced_count = 0;
-    consumed_count = 0;
-    empty_count = 0;
-    full_count = 0;
-    if (buff_snap) buffer_print();
+/// @note - buffer_shards, buffer_shard_count (from buffer.h): The shards
+int buffer_shard_remove( buffer_item* items, int max_n )
+{
+    return buffer_idle_remove(buffer_shards, buffer_shard_count, [&]() { return buffer_shard_try_remove(items, max_n); });
 }
 
-/// @brief Inserts an item into the buffer
-/// @param item The item to insert
-/// @return 1 on success, 0 on failure
+/// @name buffer_set_classes
+/// @brief Sets how priority mode shares the buffer between its classes. Call it before buffer_initialize.
+/// @param strict true to always serve the most urgent class that has items, false to serve the classes in turn
+/// @param weights In weighted mode, how many removes each class gets per turn (one per class)
+/// @param mix How often producers pick each class, relative to the others (one per class)
 /// @note This function uses the following global variables:
-/// @note - produced_counts (from project3.cpp): A map of how many items each thread has produced
-/// @note - produced_count (from buffer.h): A count of how many items have been produced
-/// @note - print_mutex (from buffer.h): A mutex so printing doesn't overlap
-/// @note - full_count (from buffer.h): A count of how many times the buffer has been full
-/// @note - buff_snap (from project3.cpp): Whether the user wants buffer snapshots displayed
-/// @note - buffer (from buffer.h): The circular buffer where items are stored
-/// @note - mutex (from buffer.h): The mutex used to synchronize access to the buffer
-/// @note - empty (from buffer.h): A semaphore representing the number of empty slots in the buffer
-/// @note - full (from buffer.h): A semaphore representing the number of full slots in the buffer
-/// @note - count (from buffer.h): The number of items currently in the buffer
-/// @note - tail (from buffer.h): The current index for writing new items into the buffer
-bool buffer_insert_item( buffer_item item )
+/// @note - buffer_class_strict, buffer_class_weights, buffer_class_mix, buffer_class_mix_total (from buffer.h): The policy
+void buffer_set_classes(bool strict, const std::vector<int>& weights, const std::vector<int>& mix)
 {
+    buffer_class_strict = strict;
+    buffer_class_weights = weights;
+    buffer_class_mix = mix;
+    buffer_class_mix_total = 0;
+    for (int m : mix) buffer_class_mix_total += m;
+}
 
-    if (sem_trywait(&empty) == -1)                      // ? Waits for a sign that the buffer has an open slot. If trywait fails, a message is output and the waiting continues!
+/// @name buffer_pick_class
+/// @brief Picks the class for the calling producer's next insert, at random in proportion to the class mix
+/// @return The class
+/// @note This function uses the following global variables:
+/// @note - buffer_class_count, buffer_class_mix, buffer_class_mix_total (from buffer.h): The classes and their mix
+/// @note - my_rng (from rng.h): The calling thread's generators
+inline int buffer_pick_class()
+{
+    int draw = (int)rng_below((uint32_t)buffer_class_mix_total);
+    for (int c = 0; c < buffer_class_count - 1; ++c)
     {
-        pthread_mutex_lock(&print_mutex);
-        printf("All buffers full. Producer %i waits.\n", gettid());
-        pthread_mutex_unlock(&print_mutex);
-
-        sem_wait(&empty);
+        draw -= buffer_class_mix[c];
+        if (draw < 0) return c;
     }
-    pthread_mutex_lock(&mutex);                             // ? Locks the mutex to change the buffer
-    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);   // ? Makes sure the pthread can't be canceled in this state
-    
-    buffer[tail] = item;                                    // ? Sets the current writing index to that item and logs success
-    pthread_mutex_lock(&print_mutex);
-    printf("\u001b[36mProducer %i\u001b[0m: writes %i\n", gettid(), item);
-    pthread_mutex_unlock(&print_mutex);
-    tail = (tail + 1) % BUFFER_SIZE;                        // ? Uses a curcular incrementation to increment the buffer's write index
-    ++count;                                                // ? Increments the count of the buffer
-    if (buff_snap) buffer_print();                          // ? Prints its status
-    ++produced_counts[gettid()];                            // ? Increments the value for this thread in the map
-    ++produced_count;                                       // ? Increments the count of total produced items
-    if (count == 5) ++full_count;                           // ? If the buffer is full, increments the count of times the buffer has been full
+    return buffer_class_count - 1;
+}
 
-    pthread_mutex_unlock(&mutex);                           // ? Unlocks the mutex
-    sem_post(&full);                                        // ? Posts that there is a new item in the buffer
-    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);    // ? Enables pthread cancelation again
+/// @name buffer_class_insert
+/// @brief Inserts a span of items into one class's queue, blocking only while that class is full (a full bulk class
+/// @brief never holds up an urgent one)
+/// @param items The items to insert
+/// @param n How many items to insert
+/// @param cls The class
+/// @return The number of items inserted (fewer than n only if the buffer was closed)
+/// @note This function uses the following global variables:
+/// @note - buffer_classes, buffer_class_totals (from buffer.h): The classes and their counters
+int buffer_class_insert( const buffer_item* items, int n, int cls )
+{
+    bounded_queue<buffer_item>* queue = buffer_classes[cls];
+    int done = queue->push_n(items, n, buffer_insert_hook<>{ queue });
+    buffer_class_totals[cls].inserted.fetch_add(done, std::memory_order_relaxed);
+    if (done > 0) buffer_wake_idle();
+    return done;
+}
+
+/// @name buffer_class_take
+/// @brief Takes up to max_n items from one class without waiting
+/// @param items Where to store the removed items
+/// @param max_n The most items to remove
+/// @param c The class
+/// @return The number of items removed
+/// @note This function uses the following global variables:
+/// @note - buffer_classes, buffer_class_totals (from buffer.h): The classes and their counters
+inline int buffer_class_take( buffer_item* items, int max_n, int c )
+{
+    bounded_queue<buffer_item>* queue = buffer_classes[c];
+    if (queue->size() == 0) return 0;                       // ? Skips empty classes without touching their locks or indices
 
-    return true;                                            // ? Returns success
+    int n = queue->try_pop_n(items, max_n, buffer_remove_hook<>{ queue });
+    if (n > 0) buffer_class_totals[c].removed.fetch_add(n, std::memory_order_relaxed);
+    return n;
 }
 
-/// @brief Removes an item from the buffer
-/// @param item The item to remove as a pointer
-/// @return 1 on success, 0 on failure
+/// @name buffer_class_try_remove
+/// @brief Takes up to max_n items from one class without waiting. Strict mode takes from the most urgent class that
+/// @brief has items. Weighted mode serves the classes in turn, each for up to its weight in removes before moving
+/// @brief on (sooner if it runs dry), so a busy urgent class can't starve the others.
+/// @param items Where to store the removed items
+/// @param max_n The most items to remove
+/// @param cls Where to store the class the items came from
+/// @return The number of items removed (0 if every class looked empty)
 /// @note This function uses the following global variables:
-/// @note - consumed_count (from buffer.h): A count of how many items have been consumed
-/// @note - consumed_counts (from project3.cpp): A map of how many items each thread has consumed
-/// @note - print_mutex (from buffer.h): A mutex so printing doesn't overlap
-/// @note - empty_count (from buffer.h): A count of how many times the buffer has been empty
-/// @note - buff_snap (from project3.cpp): Whether the user wants buffer snapshots displayed
-/// @note - buffer (from buffer.h): The circular buffer where items are stored
-/// @note - mutex (from buffer.h): The mutex used to synchronize access to the buffer
-/// @note - empty (from buffer.h): A semaphore representing the number of empty slots in the buffer
-/// @note - full (from buffer.h): A semaphore representing the number of full slots in the buffer
-/// @note - count (from buffer.h): The number of items currently in the buffer
-/// @note - head (from buffer.h): The current index for reading items from the buffer
-bool buffer_remove_item()
+/// @note - buffer_class_count, buffer_class_strict, buffer_class_weights (from buffer.h): The classes and the policy
+/// @note - buffer_class_turn, buffer_class_served (from buffer.h): Where this consumer is in its weighted turns
+int buffer_class_try_remove( buffer_item* items, int max_n, int* cls )
 {
-    buffer_item item;
+    if (buffer_class_strict)
+    {
+        for (int c = 0; c < buffer_class_count; ++c)
+        {
+            int n = buffer_class_take(items, max_n, c);
+            if (n > 0)
+            {
+                *cls = c;
+                return n;
+            }
+        }
+        return 0;
+    }
 
-    if (sem_trywait(&full))                                 // ? Waits for a sign that the buffer has a full slot. If trywait fails, a message is output and the waiting continues!
+    for (int tried = 0; tried <= buffer_class_count; ++tried)  // ? One more than the count, so the current class gets a fresh turn too
     {
-        pthread_mutex_lock(&print_mutex);
-        printf("All buffers empty. Consumer %i waits.\n", gettid());
-        pthread_mutex_unlock(&print_mutex);
+        int c = buffer_class_turn;
+        if (buffer_class_served < buffer_class_weights[c])
+        {
+            int n = buffer_class_take(items, max_n, c);
+            if (n > 0)
+            {
+                ++buffer_class_served;
+                *cls = c;
+                return n;
+            }
+        }
+        buffer_class_turn = (c + 1) % buffer_class_count;
+        buffer_class_served = 0;
+    }
+    return 0;
+}
+
+/// @name buffer_class_remove
+/// @brief Removes up to max_n items from the classes, blocking while every class is empty
+/// @param items Where to store the removed items
+/// @param max_n The most items to remove
+/// @param cls Where to store the class the items came from
+/// @return The number of items removed (0 only once the buffer is closed and every class is empty)
+/// @note This function uses the following global variables:
+/// @note - buffer_classes, buffer_class_count (from buffer.h): The classes
+int buffer_class_remove( buffer_item* items, int max_n, int* cls )
+{
+    return buffer_idle_remove(buffer_classes, buffer_class_count, [&]() { return buffer_class_try_remove(items, max_n, cls); });
+}
+
+/// @brief Inserts an item into the buffer with whichever engine was selected in buffer_initialize
+/// @brief (into the calling thread's home shard, in sharded mode, or a class picked by the class mix, in priority mode)
+/// @param item The item to insert
+/// @return 1 on success, 0 if the buffer was closed
+/// @note This function uses the following global variables:
+/// @note - buffer_queue, buffer_shm (from buffer.h): The buffer
+bool buffer_insert_item( buffer_item item )
+{
+    if (buffer_shm != NULL) return buffer_shm->push_n(&item, 1, buffer_insert_hook<shm_ring<buffer_item>>{ buffer_shm }) == 1;
+    if (buffer_class_count > 0) return buffer_class_insert(&item, 1, buffer_pick_class()) == 1;
+    if (buffer_shard_count > 0) return buffer_shard_insert(&item, 1) == 1;
+    return buffer_queue->push(item, buffer_insert_hook<>{ buffer_queue });
+}
 
-        sem_wait(&full);
+/// @brief Removes an item from the buffer with whichever engine was selected in buffer_initialize
+/// @brief (from the home shard, or stolen from another one, in sharded mode, or by class priority, in priority mode)
+/// @param item Where to store the removed item. Defaults to NULL, which throws it away.
+/// @return 1 on success, 0 if the buffer was closed and is empty
+/// @note This function uses the following global variables:
+/// @note - buffer_queue, buffer_shm (from buffer.h): The buffer
+bool buffer_remove_item( buffer_item* item = NULL )
+{
+    buffer_item removed;
+    if (buffer_shm != NULL)
+    {
+        if (buffer_shm->pop_n(&removed, 1, buffer_remove_hook<shm_ring<buffer_item>>{ buffer_shm }) == 0) return false;
+    }
+    else if (buffer_class_count > 0)
+    {
+        int cls;
+        if (buffer_class_remove(&removed, 1, &cls) == 0) return false;
+    }
+    else if (buffer_shard_count > 0)
+    {
+        if (buffer_shard_remove(&removed, 1) == 0) return false;
+    }
+    else if (!buffer_queue->pop(removed, buffer_remove_hook<>{ buffer_queue }))
+    {
+        return false;
     }
-    pthread_mutex_lock(&mutex);                             // ? Locks the mutex to change the buffer
-    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);   // ? Makes sure the pthread can't be canceled in this state
+    if (item != NULL) *item = removed;
+    return true;
+}
 
-    item = buffer[head];                                    // ? Sets the item to the item in the current reading index
-    pthread_mutex_lock(&print_mutex);
-    printf("\u001b[35mConsumer %i\u001b[0m: reads %i\n", gettid(), item);
-    pthread_mutex_unlock(&print_mutex);
-    head = (head + 1) % BUFFER_SIZE;                        // ? Uses a curcular incrementation to increment the buffer's read index
-    --count;                                                // ? Decrements the count of the buffer
-    if (buff_snap) buffer_print();                          // ? Prints its status
-    ++consumed_counts[gettid()];                            // ? Increments the thread's count of how many times it has eaten an item
-    ++consumed_count;                                       // ? Increments the count of how many items have been consumed
-    if (count == 0) ++empty_count;                          // ? If the count of items in the buffer is 0, increments the total number of times the buffer has been empty
-    
-    pthread_mutex_unlock(&mutex);                           // ? Unlocks the mutex
-    sem_post(&empty);                                       // ? Posts that there is a new empty slot in the buffer
-    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);    // ? Enables the pthread's ability to be canceled
-    
-    return true;                                            // ? Returns success
+/// @brief Inserts a span of items into the buffer with whichever engine was selected in buffer_initialize
+/// @brief (into the calling thread's home shard, in sharded mode, or one class, in priority mode).
+/// @brief Blocks until every item has been inserted, publishing as many at a time as there is room for.
+/// @param items The items to insert
+/// @param n How many items to insert
+/// @param cls In priority mode, the class the whole span goes to. Defaults to -1, which picks one by the class mix.
+/// @return The number of items inserted (fewer than n only if the buffer was closed)
+/// @note This function uses the following global variables:
+/// @note - buffer_queue, buffer_shm (from buffer.h): The buffer
+int buffer_insert_items( const buffer_item* items, int n, int cls = -1 )
+{
+    if (buffer_shm != NULL) return buffer_shm->push_n(items, n, buffer_insert_hook<shm_ring<buffer_item>>{ buffer_shm });
+    if (buffer_class_count > 0) return buffer_class_insert(items, n, cls < 0 ? buffer_pick_class() : cls);
+    if (buffer_shard_count > 0) return buffer_shard_insert(items, n);
+    return buffer_queue->push_n(items, n, buffer_insert_hook<>{ buffer_queue });
+}
+
+/// @brief Removes up to max_n items from the buffer with whichever engine was selected in buffer_initialize
+/// @brief (from the home shard, or stolen from another one, in sharded mode, or from one class, in priority mode).
+/// @brief Blocks until at least one item is available, then takes as many as are there (up to max_n).
+/// @param items Where to store the removed items
+/// @param max_n The most items to remove
+/// @param cls Where to store the class the items came from, in priority mode. Defaults to NULL.
+/// @return The number of items removed (0 only once the buffer is closed and empty)
+/// @note This function uses the following global variables:
+/// @note - buffer_queue, buffer_shm (from buffer.h): The buffer
+int buffer_remove_items( buffer_item* items, int max_n, int* cls = NULL )
+{
+    if (buffer_shm != NULL) return buffer_shm->pop_n(items, max_n, buffer_remove_hook<shm_ring<buffer_item>>{ buffer_shm });
+    if (buffer_class_count > 0)
+    {
+        int removed_cls;
+        int n = buffer_class_remove(items, max_n, &removed_cls);
+        if (cls != NULL && n > 0) *cls = removed_cls;
+        return n;
+    }
+    if (buffer_shard_count > 0) return buffer_shard_remove(items, max_n);
+    return buffer_queue->pop_n(items, max_n, buffer_remove_hook<>{ buffer_queue });
 }
 
 #endif // _BUFFER_H_DEFINED_
@@ -0,0 +1,112 @@
+// **********************************************************
+// *
+// * Sam Young
+// * Operating Systems
+// * Programming Project 3: Process Synchronization
+// * March 14, 2025
+// * Dr. Siming Liu
+// *
+// **********************************************************
+
+#ifndef _HISTOGRAM_H_DEFINED_
+#define _HISTOGRAM_H_DEFINED_
+
+#define HISTOGRAM_SUB_BITS      6                                   // ? 2^6 sub-buckets per power of two (about 1.6% precision)
+#define HISTOGRAM_SUB_COUNT     (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS       (HISTOGRAM_SUB_COUNT * 60)          // ? Enough to cover every 64-bit value
+
+#include <cstdint>
+#include <cstring>
+
+/// @brief A log-linear (HDR-style) histogram of nanosecond latencies. Recording is a bit scan, a shift and an
+/// @brief increment, with no allocation and no lock; every histogram is owned by one thread and merged at the end.
+struct latency_histogram
+{
+    uint64_t    counts[HISTOGRAM_BUCKETS];  // ? How many values landed in each bucket
+    uint64_t    total;                      // ? How many values were recorded
+    uint64_t    max;                        // ? The largest value recorded
+};
+
+/// @name histogram_clear
+/// @brief Empties a histogram
+/// @param h The histogram
+inline void histogram_clear(latency_histogram* h)
+{
+    memset(h, 0, sizeof(*h));
+}
+
+/// @name histogram_bucket
+/// @brief Finds the bucket a value belongs in. Values below 2 * HISTOGRAM_SUB_COUNT get a bucket each; above that,
+/// @brief every power of two is split into HISTOGRAM_SUB_COUNT equal buckets.
+/// @param v The value
+/// @return The bucket's index
+inline int histogram_bucket(uint64_t v)
+{
+    int msb = 63 - __builtin_clzll(v | 1);
+    int shift = (msb > HISTOGRAM_SUB_BITS) ? msb - HISTOGRAM_SUB_BITS : 0;
+    return shift * HISTOGRAM_SUB_COUNT + (int)(v >> shift);
+}
+
+/// @name histogram_bucket_top
+/// @brief Gets the largest value a bucket can hold, which is what percentiles report
+/// @param index The bucket's index
+/// @return The bucket's upper bound
+inline uint64_t histogram_bucket_top(int index)
+{
+    int shift = (index < 2 * HISTOGRAM_SUB_COUNT) ? 0 : index / HISTOGRAM_SUB_COUNT - 1;
+    uint64_t sub = (uint64_t)(index - shift * HISTOGRAM_SUB_COUNT);
+    return ((sub + 1) << shift) - 1;
+}
+
+/// @name histogram_record
+/// @brief Records one value
+/// @param h The histogram
+/// @param v The value
+inline void histogram_record(latency_histogram* h, uint64_t v)
+{
+    ++h->counts[histogram_bucket(v)];
+    ++h->total;
+    if (v > h->max) h->max = v;
+}
+
+/// @name histogram_merge
+/// @brief Adds every value in one histogram to another
+/// @param into The histogram to add to
+/// @param from The histogram to add
+void histogram_merge(latency_histogram* into, const latency_histogram* from)
+{
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+    {
+        into->counts[i] += from->counts[i];
+    }
+    into->total += from->total;
+    if (from->max > into->max) into->max = from->max;
+}
+
+/// @name histogram_percentile
+/// @brief Gets the value at or below which a fraction of the recorded values fall
+/// @param h The histogram
+/// @param p The percentile, e.g. 99.9
+/// @return The percentile's value (the top of its bucket, capped at the real maximum)
+uint64_t histogram_percentile(const latency_histogram* h, double p)
+{
+    if (h->total == 0) return 0;
+
+    uint64_t rank = (uint64_t)(p / 100.0 * (double)h->total + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > h->total) rank = h->total;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+    {
+        seen += h->counts[i];
+        if (seen >= rank)
+        {
+            uint64_t top = histogram_bucket_top(i);
+            return (top < h->max) ? top : h->max;
+        }
+    }
+    return h->max;
+}
+
+#endif // _HISTOGRAM_H_DEFINED_
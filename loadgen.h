@@ -0,0 +1,358 @@
+// **********************************************************
+// *
+// * Sam Young
+// * Operating Systems
+// * Programming Project 3: Process Synchronization
+// * March 14, 2025
+// * Dr. Siming Liu
+// *
+// **********************************************************
+
+#ifndef _LOADGEN_H_DEFINED_
+#define _LOADGEN_H_DEFINED_
+
+#define LOAD_SLICE_NS 10000000ull   // ? The longest a paced thread sleeps before checking whether the run has stopped
+
+#include <time.h>
+#include <errno.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <atomic>
+#include "log.h"
+#include "rng.h"
+
+extern std::atomic<bool> execute;   // ? Whether the run is still going (from project3.cpp)
+
+/// @brief The shapes of load a thread can be paced with
+enum load_pattern
+{
+    LOAD_NONE,      // ? Flat out, no pacing
+    LOAD_UNIFORM,   // ? A think time drawn evenly from [low, high], counted from when the thread is ready again
+    LOAD_FIXED,     // ? Exactly one gap between events
+    LOAD_POISSON,   // ? Exponentially distributed gaps with a mean (a Poisson process)
+    LOAD_ONOFF,     // ? Bursts of events a fixed gap apart, separated by silences
+    LOAD_TRACE,     // ? Gaps replayed from a file, in a loop
+};
+
+/// @brief A load pattern and its settings, as read from the command line. All times are in nanoseconds.
+struct load_spec
+{
+    load_pattern            pattern = LOAD_NONE;
+    uint64_t                gap = 0;        // ? The fixed or mean gap (fixed, Poisson, and inside on-off bursts)
+    uint64_t                low = 0;        // ? Uniform: the shortest think time
+    uint64_t                high = 0;       // ? Uniform: the longest think time
+    uint64_t                on = 0;         // ? On-off: how long each burst lasts
+    uint64_t                off = 0;        // ? On-off: how long each silence lasts
+    std::vector<uint64_t>   trace;          // ? Trace: the gaps, in order
+    std::string             source;         // ? What the user wrote, for the log
+};
+
+/// @brief One thread's place in its load pattern
+struct load_pacer
+{
+    const load_spec*    spec;       // ? The pattern
+    uint64_t            deadline;   // ? When the last event was due (log_now nanoseconds)
+    uint64_t            burst_end;  // ? On-off: when the current burst ends
+    size_t              trace_pos;  // ? Trace: the next gap to replay
+    int                 stream;     // ? Trace: which of the threads sharing the trace this is
+    int                 streams;    // ? Trace: how many threads share it
+    bool                started;    // ? Whether the first event has happened yet
+};
+
+/// @name load_parse_duration
+/// @brief Reads a duration like "250ns", "100us", "1.5ms" or "2s" (no unit means nanoseconds)
+/// @param text The duration
+/// @param end Where to store a pointer just past it
+/// @param out Where to store the duration, in nanoseconds
+/// @return true if it was a duration, false otherwise
+bool load_parse_duration(const char* text, const char** end, uint64_t* out)
+{
+    char* rest;
+    double value = strtod(text, &rest);
+    if (rest == text || value < 0) return false;
+
+    double scale = 1.0;
+    if      (strncmp(rest, "ns", 2) == 0) { rest += 2; }
+    else if (strncmp(rest, "us", 2) == 0) { rest += 2; scale = 1e3; }
+    else if (strncmp(rest, "ms", 2) == 0) { rest += 2; scale = 1e6; }
+    else if (*rest == 's')                { rest += 1; scale = 1e9; }
+
+    *out = (uint64_t)llround(value * scale);
+    *end = rest;
+    return true;
+}
+
+/// @name load_parse_durations
+/// @brief Reads a comma-separated list of exactly count durations, e.g. "10us,5ms,20ms"
+/// @param text The list
+/// @param count How many durations there must be
+/// @param out Where to store them, in nanoseconds
+/// @return true if the list had exactly count durations, false otherwise
+bool load_parse_durations(const char* text, int count, uint64_t* out)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        const char* end;
+        if (!load_parse_duration(text, &end, &out[i])) return false;
+        if (i + 1 < count && *end != ',') return false;
+        text = end + (i + 1 < count ? 1 : 0);
+    }
+    return *text == '\0';
+}
+
+/// @name load_read_trace
+/// @brief Reads a trace file: one gap per line, as a duration (e.g. inter-arrival gaps exported from production).
+/// @brief Blank lines and lines starting with '#' are skipped.
+/// @param path The file
+/// @param out Where to store the gaps, in nanoseconds
+/// @param error Where to describe what went wrong, on failure
+/// @return true on success, false otherwise
+bool load_read_trace(const char* path, std::vector<uint64_t>* out, std::string* error)
+{
+    FILE* in = fopen(path, "r");
+    if (in == NULL)
+    {
+        *error = std::string(path) + ": " + strerror(errno);
+        return false;
+    }
+
+    char line[256];
+    int number = 0;
+    out->clear();
+    while (fgets(line, sizeof(line), in) != NULL)
+    {
+        ++number;
+        char* text = line;
+        while (*text == ' ' || *text == '\t') ++text;
+        text[strcspn(text, "\r\n")] = '\0';
+        if (*text == '\0' || *text == '#') continue;
+
+        const char* end;
+        uint64_t gap;
+        if (!load_parse_duration(text, &end, &gap) || *end != '\0')
+        {
+            *error = std::string(path) + ":" + std::to_string(number) + ": not a duration";
+            fclose(in);
+            return false;
+        }
+        out->push_back(gap);
+    }
+    fclose(in);
+
+    uint64_t total = 0;
+    for (uint64_t gap : *out) total += gap;
+    if (total == 0)                                         // ? A trace that never advances would replay forever at once
+    {
+        *error = std::string(path) + ": the trace has no gaps";
+        return false;
+    }
+    return true;
+}
+
+/// @name load_parse
+/// @brief Reads a load pattern from the command line: "none", "fixed:<gap>", "poisson:<mean gap>",
+/// @brief "onoff:<gap>,<on>,<off>", "uniform:<low>,<high>" or "trace:<path>"
+/// @param text The pattern
+/// @param out Where to store it
+/// @param error Where to describe what went wrong, on failure
+/// @return true on success, false otherwise
+bool load_parse(const char* text, load_spec* out, std::string* error)
+{
+    *out = load_spec();
+    out->source = text;
+
+    uint64_t values[3];
+    bool ok;
+    if (strcmp(text, "none") == 0)
+    {
+        return true;
+    }
+    else if (strncmp(text, "fixed:", 6) == 0)
+    {
+        out->pattern = LOAD_FIXED;
+        ok = load_parse_durations(text + 6, 1, &out->gap);
+    }
+    else if (strncmp(text, "poisson:", 8) == 0)
+    {
+        out->pattern = LOAD_POISSON;
+        ok = load_parse_durations(text + 8, 1, &out->gap);
+    }
+    else if (strncmp(text, "onoff:", 6) == 0)
+    {
+        out->pattern = LOAD_ONOFF;
+        ok = load_parse_durations(text + 6, 3, values) && values[1] > 0;
+        out->gap = values[0];
+        out->on = values[1];
+        out->off = values[2];
+    }
+    else if (strncmp(text, "uniform:", 8) == 0)
+    {
+        out->pattern = LOAD_UNIFORM;
+        ok = load_parse_durations(text + 8, 2, values) && values[0] <= values[1];
+        out->low = values[0];
+        out->high = values[1];
+    }
+    else if (strncmp(text, "trace:", 6) == 0)
+    {
+        out->pattern = LOAD_TRACE;
+        return load_read_trace(text + 6, &out->trace, error);
+    }
+    else
+    {
+        *error = "must be none, fixed:<gap>, poisson:<mean>, onoff:<gap>,<on>,<off>, uniform:<low>,<high> or trace:<path>";
+        return false;
+    }
+
+    if (!ok) *error = std::string("\"") + text + "\" has a bad duration (e.g. 250ns, 100us, 1.5ms, 2s)";
+    return ok;
+}
+
+/// @name load_uniform_seconds
+/// @brief Builds the original pacing: a think time of 1 to max_seconds seconds (or none, for 0)
+/// @param max_seconds The longest think time
+/// @return The pattern
+load_spec load_uniform_seconds(int max_seconds)
+{
+    load_spec spec;
+    if (max_seconds <= 0) return spec;
+
+    spec.pattern = LOAD_UNIFORM;
+    spec.low = 1000000000ull;
+    spec.high = (uint64_t)max_seconds * 1000000000ull;
+    spec.source = "uniform:1s," + std::to_string(max_seconds) + "s";
+    return spec;
+}
+
+/// @name load_start
+/// @brief Starts a thread's pacing now
+/// @param pacer The thread's pacer
+/// @param spec The pattern to follow
+/// @param stream Which of the threads sharing a trace this is (from 0). Every thread follows the other patterns
+/// @param stream on its own, but a trace is dealt out between them, so together they replay it event for event.
+/// @param streams How many threads share the pattern
+void load_start(load_pacer* pacer, const load_spec* spec, int stream = 0, int streams = 1)
+{
+    pacer->spec = spec;
+    pacer->deadline = log_now();
+    pacer->burst_end = pacer->deadline + spec->on;
+    pacer->trace_pos = 0;
+    pacer->stream = stream;
+    pacer->streams = streams > 0 ? streams : 1;
+    pacer->started = false;
+}
+
+/// @name load_exponential
+/// @brief Draws an exponentially distributed gap
+/// @param mean The mean gap
+/// @return The gap
+/// @note This function uses the following global variables:
+/// @note - my_rng (from rng.h): The calling thread's generators
+inline uint64_t load_exponential(uint64_t mean)
+{
+    double u = ((rng_next() >> 11) + 1) * (1.0 / 9007199254740992.0);  // ? Uniform on (0, 1], so the log is finite
+    return (uint64_t)(-log(u) * (double)mean);
+}
+
+/// @name load_gap
+/// @brief Draws the gap before a thread's next event
+/// @param pacer The thread's pacer
+/// @return The gap, in nanoseconds
+/// @note This function uses the following global variables:
+/// @note - my_rng (from rng.h): The calling thread's generators
+uint64_t load_gap(load_pacer* pacer)
+{
+    const load_spec* spec = pacer->spec;
+    switch (spec->pattern)
+    {
+        case LOAD_UNIFORM:
+            return spec->low + (uint64_t)((rng_next() >> 11) * (1.0 / 9007199254740992.0) * (double)(spec->high - spec->low));
+        case LOAD_FIXED:
+        case LOAD_ONOFF:
+            return spec->gap;
+        case LOAD_POISSON:
+            return load_exponential(spec->gap);
+        case LOAD_TRACE:
+        {
+            int take = pacer->started ? pacer->streams : pacer->stream + 1;    // ? Every streams-th event is this thread's
+            uint64_t gap = 0;
+            for (int i = 0; i < take; ++i)
+            {
+                gap += spec->trace[pacer->trace_pos];
+                pacer->trace_pos = (pacer->trace_pos + 1) % spec->trace.size();
+            }
+            return gap;
+        }
+        default:
+            return 0;
+    }
+}
+
+/// @name load_sleep_until
+/// @brief Sleeps until an absolute time on the steady clock with clock_nanosleep, a slice at a time so the thread
+/// @brief notices within LOAD_SLICE_NS when the run stops
+/// @param deadline When to wake (log_now nanoseconds)
+/// @return true once the deadline has passed, false if the run stopped first
+/// @note This function uses the following global variables:
+/// @note - execute (from project3.cpp): Whether the run is still going
+bool load_sleep_until(uint64_t deadline)
+{
+    for (;;)
+    {
+        if (!execute.load(std::memory_order_relaxed)) return false;
+        uint64_t now = log_now();
+        if (now >= deadline) return true;
+
+        uint64_t until = (deadline - now > LOAD_SLICE_NS) ? now + LOAD_SLICE_NS : deadline;
+        timespec wake = { (time_t)(until / 1000000000ull), (long)(until % 1000000000ull) };
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL);  // ? Absolute, so an early or late wake-up never adds up
+    }
+}
+
+/// @name load_arrive
+/// @brief Waits for a thread's next arrival. Arrivals follow a fixed schedule from load_start: each deadline is the
+/// @brief last one plus the next gap, so time spent blocked on the buffer doesn't shift later arrivals, and a thread
+/// @brief that falls behind catches up right away (the exception is a uniform think time, which starts once the
+/// @brief thread is ready again, like the original sleep).
+/// @param pacer The thread's pacer
+/// @return The time the arrival was due (log_now nanoseconds), or 0 if the run stopped first
+uint64_t load_arrive(load_pacer* pacer)
+{
+    const load_spec* spec = pacer->spec;
+    if (spec->pattern == LOAD_NONE) return execute.load(std::memory_order_relaxed) ? log_now() : 0;
+
+    uint64_t gap = load_gap(pacer);
+    if (spec->pattern == LOAD_UNIFORM) pacer->deadline = log_now();
+    uint64_t next = pacer->deadline + gap;
+    if (spec->pattern == LOAD_ONOFF && next >= pacer->burst_end)   // ? The burst is over: the next one starts after the silence
+    {
+        next = pacer->burst_end + spec->off;
+        pacer->burst_end = next + spec->on;
+    }
+    pacer->deadline = next;
+    pacer->started = true;
+
+    return load_sleep_until(next) ? next : 0;
+}
+
+/// @name load_serve
+/// @brief Spends a consumer's service time on the items it just removed: one draw per item, counted from now
+/// @param pacer The thread's pacer
+/// @param n How many items were removed
+/// @return false if the run stopped before the service time was up, true otherwise
+bool load_serve(load_pacer* pacer, int n)
+{
+    if (pacer->spec->pattern == LOAD_NONE) return true;
+
+    uint64_t total = 0;
+    for (int i = 0; i < n; ++i) total += load_gap(pacer);
+    pacer->started = true;
+    pacer->deadline = log_now() + total;
+    return load_sleep_until(pacer->deadline);
+}
+
+#endif // _LOADGEN_H_DEFINED_
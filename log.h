@@ -0,0 +1,452 @@
+// **********************************************************
+// *
+// * Sam Young
+// * Operating Systems
+// * Programming Project 3: Process Synchronization
+// * March 14, 2025
+// * Dr. Siming Liu
+// *
+// **********************************************************
+
+#ifndef _LOG_H_DEFINED_
+#define _LOG_H_DEFINED_
+
+#define LOG_RING_SIZE       4096    // ? Events each thread can have waiting for the writer (a power of two)
+#define LOG_SNAPSHOT_MAX    32      // ? The most buffer slots a snapshot event carries
+#define LOG_IDLE_NS         1000000 // ? How long the writer sleeps when no thread has logged anything
+
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <cstdio>
+#include <cstdint>
+#include <atomic>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+/// @brief What a log event records
+enum log_op : uint8_t
+{
+    LOG_WRITE,          // ? A producer wrote an item
+    LOG_READ,           // ? A consumer read an item
+    LOG_FULL_WAIT,      // ? A producer found the buffer full and is waiting
+    LOG_EMPTY_WAIT,     // ? A consumer found the buffer empty and is waiting
+    LOG_SNAPSHOT        // ? A copy of the buffer's state, taken when snapshots are enabled
+};
+
+/// @brief The compact binary record the hot path writes. Everything is formatted later by the writer thread.
+struct log_event
+{
+    uint64_t    timestamp;  // ? steady clock nanoseconds, used to merge the threads' rings in order
+    int32_t     tid;        // ? The thread that logged the event
+    int32_t     value;      // ? The item written or read
+    int32_t     occupancy;  // ? How many items were in the buffer right after the operation
+    log_op      op;         // ? What happened
+};
+
+/// @brief A copy of the buffer's state, enough to draw the same picture buffer_print does
+struct log_snapshot
+{
+    int     occupancy;                  // ? How many items were in the buffer
+    int     capacity;                   // ? The buffer's capacity
+    int     head;                       // ? The slot being read next
+    int     tail;                       // ? The slot being written next
+    int     shown;                      // ? How many of the buffer's first slots are drawn
+    bool    copied;                     // ? Whether items holds their contents (only taken under the buffer's lock)
+    int     items[LOG_SNAPSHOT_MAX];    // ? The first slots of the buffer
+};
+
+/// @brief One thread's single-producer/single-consumer event ring. The thread pushes, the writer pops.
+struct log_ring
+{
+    alignas(64) std::atomic<size_t> head;   // ? Next event the thread will write (only the thread stores to it)
+    std::atomic<uint64_t>   in_flight;      // ? When the thread began an event it hasn't published yet (0 if none; only the thread stores to it)
+    std::atomic<size_t>     dropped;        // ? Events the thread had no room for (only the thread stores to it)
+    alignas(64) std::atomic<size_t> tail;   // ? Next event the writer will read (only the writer stores to it)
+    size_t          reported;               // ? How many of the dropped events the writer has reported
+    log_event       events[LOG_RING_SIZE];  // ? The events
+    log_snapshot*   snapshots;              // ? The snapshot carried by each LOG_SNAPSHOT event, or NULL if snapshots are off
+};
+
+bool                    log_enabled = false;        // ? Whether per-item output is being produced at all (false in quiet mode)
+bool                    log_snapshots = false;      // ? Whether rings need room for buffer snapshots
+std::atomic<bool>       log_running(false);         // ? Tells the writer thread to keep going
+pthread_t               log_thread;                 // ? The background writer thread
+pthread_mutex_t         log_registry_mutex = PTHREAD_MUTEX_INITIALIZER;    // ? Guards log_rings, only taken when a thread registers
+std::vector<log_ring*>  log_rings;                  // ? Every thread's ring
+long                    log_dropped = 0;            // ? Events dropped because the writer fell a whole ring behind
+thread_local log_ring*  log_my_ring = NULL;         // ? This thread's ring, created on its first event
+thread_local pid_t      log_my_tid = 0;             // ? This thread's id, looked up once instead of per event
+
+/// @name log_now
+/// @brief Reads the steady clock
+/// @return The time in nanoseconds
+inline uint64_t log_now()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/// @name log_tid
+/// @brief Gets the calling thread's id without a syscall after the first call
+/// @return The thread's id
+inline pid_t log_tid()
+{
+    if (log_my_tid == 0) log_my_tid = gettid();
+    return log_my_tid;
+}
+
+/// @name log_thread_ring
+/// @brief Gets the calling thread's ring, registering a new one with the writer the first time
+/// @return The thread's ring
+/// @note This function uses the following global variables:
+/// @note - log_registry_mutex (from log.h): Guards log_rings
+/// @note - log_snapshots (from log.h): Whether to allocate room for snapshots
+/// @note - log_rings (from log.h): Every thread's ring
+inline log_ring* log_thread_ring()
+{
+    if (log_my_ring == NULL)
+    {
+        log_ring* ring = new log_ring();
+        ring->head.store(0, std::memory_order_relaxed);
+        ring->in_flight.store(0, std::memory_order_relaxed);
+        ring->dropped.store(0, std::memory_order_relaxed);
+        ring->tail.store(0, std::memory_order_relaxed);
+        ring->reported = 0;
+        ring->snapshots = log_snapshots ? new log_snapshot[LOG_RING_SIZE] : NULL;
+
+        pthread_mutex_lock(&log_registry_mutex);
+        log_rings.push_back(ring);
+        pthread_mutex_unlock(&log_registry_mutex);
+        log_my_ring = ring;
+    }
+    return log_my_ring;
+}
+
+/// @name log_claim
+/// @brief Claims the next free event in the calling thread's ring, marks it in flight and stamps it. If the writer
+/// @brief has fallen a whole ring behind, the event is dropped and counted instead of waiting for room: events are
+/// @brief recorded inside the buffer's critical section, so waiting would let a slow terminal throttle the data path.
+/// @brief The writer reports the gap in the output.
+/// @param ring The calling thread's ring
+/// @param pos Where to store the position of the claimed event; publish it with log_publish
+/// @return The event's timestamp, or 0 if it was dropped
+inline uint64_t log_claim(log_ring* ring, size_t* pos)
+{
+    *pos = ring->head.load(std::memory_order_relaxed);
+    if (*pos - ring->tail.load(std::memory_order_acquire) >= LOG_RING_SIZE)
+    {
+        ring->dropped.store(ring->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return 0;
+    }
+    ring->in_flight.store(log_now(), std::memory_order_seq_cst);  // ? No later than the stamp below (see log_drain)
+    return log_now();
+}
+
+/// @name log_publish
+/// @brief Hands a claimed event over to the writer thread
+/// @param ring The calling thread's ring
+/// @param pos The position log_claim stored
+inline void log_publish(log_ring* ring, size_t pos)
+{
+    ring->head.store(pos + 1, std::memory_order_release);
+    ring->in_flight.store(0, std::memory_order_seq_cst);
+}
+
+/// @name log_record
+/// @brief Records an event from the hot path. This is a handful of stores into the thread's own ring; nothing is
+/// @brief formatted or printed here.
+/// @param op What happened
+/// @param value The item written or read (ignored for waits)
+/// @param occupancy How many items are in the buffer now
+/// @note This function uses the following global variables:
+/// @note - log_enabled (from log.h): Whether per-item output is being produced
+inline void log_record(log_op op, int value, int occupancy)
+{
+    if (!log_enabled) return;
+
+    log_ring* ring = log_thread_ring();
+    size_t pos;
+    uint64_t now = log_claim(ring, &pos);
+    if (now == 0) return;
+    log_event& e = ring->events[pos & (LOG_RING_SIZE - 1)];
+    e.timestamp = now;
+    e.tid = log_tid();
+    e.value = value;
+    e.occupancy = occupancy;
+    e.op = op;
+    log_publish(ring, pos);
+}
+
+/// @name log_record_snapshot
+/// @brief Records a copy of the buffer's state to be drawn by the writer thread
+/// @param snap The snapshot to copy
+/// @note This function uses the following global variables:
+/// @note - log_enabled (from log.h): Whether per-item output is being produced
+/// @note - log_snapshots (from log.h): Whether rings have room for snapshots
+inline void log_record_snapshot(const log_snapshot& snap)
+{
+    if (!log_enabled || !log_snapshots) return;
+
+    log_ring* ring = log_thread_ring();
+    size_t pos;
+    uint64_t now = log_claim(ring, &pos);
+    if (now == 0) return;
+    log_event& e = ring->events[pos & (LOG_RING_SIZE - 1)];
+    e.timestamp = now;
+    e.tid = log_tid();
+    e.value = 0;
+    e.occupancy = snap.occupancy;
+    e.op = LOG_SNAPSHOT;
+    ring->snapshots[pos & (LOG_RING_SIZE - 1)] = snap;
+    log_publish(ring, pos);
+}
+
+/// @name log_format_snapshot
+/// @brief Draws a snapshot of the buffer, the same picture buffer_print has always drawn
+/// @param out Where to append the text
+/// @param snap The snapshot to draw
+/// @param prime_marker Whether to mark the line as having just handled a prime number
+void log_format_snapshot(std::string& out, const log_snapshot& snap, bool prime_marker = false)
+{
+    char line[64];
+
+    snprintf(line, sizeof(line), "(buffers occupied %i of %i)", snap.occupancy, snap.capacity);
+    out += line;
+    if (prime_marker) out += "\t* * * PRIME * * *";
+    out += "\nbuffers: ";
+
+    for (int i = 0; i < snap.shown; ++i)
+    {
+        if (snap.copied) snprintf(line, sizeof(line), "%*i", 5, snap.items[i]);
+        else             snprintf(line, sizeof(line), "%*s", 5, "?");  // ? A lock-free buffer's slots can't be read safely
+        out += line;
+    }
+    if (snap.shown < snap.capacity)
+    {
+        snprintf(line, sizeof(line), "  ... (%i more)", snap.capacity - snap.shown);
+        out += line;
+    }
+
+    out += "\n\t  ";
+    for (int i = 0; i < snap.shown; ++i)
+    {
+        out += "---- ";
+    }
+
+    out += "\n\t  ";
+    for (int i = 0; i < snap.shown; ++i)
+    {
+        if (i == snap.head && i == snap.tail)   out += " RW ";
+        else if (i == snap.head)                out += " R  ";
+        else if (i == snap.tail)                out += "  W ";
+        else                                    out += "    ";
+        out += " ";
+    }
+    out += "\n";
+}
+
+/// @name log_format_event
+/// @brief Formats one event the same way the buffer used to print it directly
+/// @param out Where to append the text
+/// @param e The event
+/// @param snap The event's snapshot (only used for LOG_SNAPSHOT events)
+void log_format_event(std::string& out, const log_event& e, const log_snapshot* snap)
+{
+    char line[96];
+
+    switch (e.op)
+    {
+        case LOG_WRITE:
+            snprintf(line, sizeof(line), "\u001b[36mProducer %i\u001b[0m: writes %i\n", e.tid, e.value);
+            break;
+        case LOG_READ:
+            snprintf(line, sizeof(line), "\u001b[35mConsumer %i\u001b[0m: reads %i\n", e.tid, e.value);
+            break;
+        case LOG_FULL_WAIT:
+            snprintf(line, sizeof(line), "All buffers full. Producer %i waits.\n", e.tid);
+            break;
+        case LOG_EMPTY_WAIT:
+            snprintf(line, sizeof(line), "All buffers empty. Consumer %i waits.\n", e.tid);
+            break;
+        case LOG_SNAPSHOT:
+            if (snap != NULL) log_format_snapshot(out, *snap);
+            return;
+    }
+    out += line;
+}
+
+/// @brief A drained event plus the snapshot it carries, so the writer can sort them together
+struct log_pending
+{
+    log_event       event;
+    int             snapshot;   // ? The event's snapshot in the writer's list (-1 for none)
+};
+
+/// @name log_drain
+/// @brief Pulls every published event out of every ring, merges them by timestamp, formats them and writes the
+/// @brief whole batch to stdout in one go. Only events older than the low watermark are written; the rest are held
+/// @brief for the next batch, so an event a thread stamped but hadn't published yet still comes out in order.
+/// @param final Whether every thread has stopped logging, so everything left can be written
+/// @return The number of events written
+/// @note This function uses the following global variables:
+/// @note - log_registry_mutex (from log.h): Guards log_rings
+/// @note - log_rings (from log.h): Every thread's ring
+/// @note - log_dropped (from log.h): Events dropped because the writer fell behind
+size_t log_drain(bool final = false)
+{
+    static std::vector<log_pending> pending;    // ? Events drained but not yet written (some carried over from the last batch)
+    static std::vector<log_snapshot> snaps;     // ? Their snapshots
+    static std::vector<log_pending> held;
+    static std::vector<log_snapshot> held_snaps;
+    static std::string text;
+
+    // ? The low watermark: any event not drained below was stamped after its thread's in-flight mark, or (if the
+    // ? thread wasn't marked yet) after now. Now is read first, so a thread that registers a ring after the copy
+    // ? below stamps its events later still.
+    uint64_t watermark = final ? UINT64_MAX : log_now();
+
+    pthread_mutex_lock(&log_registry_mutex);
+    std::vector<log_ring*> rings = log_rings;
+    pthread_mutex_unlock(&log_registry_mutex);
+
+    for (log_ring* ring : rings)                            // ? Marks first: a thread that publishes after we read its
+    {                                                       // ? head was still marked when we read its mark
+        uint64_t since = ring->in_flight.load(std::memory_order_seq_cst);
+        if (since != 0 && since < watermark) watermark = since;
+    }
+
+    long dropped = 0;
+    std::vector<std::pair<log_ring*, size_t>> drained;
+    for (log_ring* ring : rings)
+    {
+        size_t tail = ring->tail.load(std::memory_order_relaxed);
+        size_t head = ring->head.load(std::memory_order_acquire);
+        for (size_t pos = tail; pos != head; ++pos)
+        {
+            const log_event& e = ring->events[pos & (LOG_RING_SIZE - 1)];
+            int snapshot = -1;
+            if (e.op == LOG_SNAPSHOT && ring->snapshots != NULL)
+            {
+                snapshot = (int)snaps.size();
+                snaps.push_back(ring->snapshots[pos & (LOG_RING_SIZE - 1)]);
+            }
+            pending.push_back({ e, snapshot });
+        }
+        drained.push_back({ ring, head });
+
+        size_t lost = ring->dropped.load(std::memory_order_relaxed);
+        dropped += (long)(lost - ring->reported);
+        ring->reported = lost;
+    }
+
+    // ? Hands the slots back before formatting, so the threads aren't held up by our I/O
+    for (auto& d : drained)
+    {
+        d.first->tail.store(d.second, std::memory_order_release);
+    }
+
+    std::stable_sort(pending.begin(), pending.end(), [](const log_pending& a, const log_pending& b)
+    {
+        return a.event.timestamp < b.event.timestamp;
+    });
+
+    text.clear();
+    size_t written = 0;
+    held.clear();
+    held_snaps.clear();
+    for (log_pending& p : pending)
+    {
+        if (p.event.timestamp < watermark)
+        {
+            log_format_event(text, p.event, p.snapshot >= 0 ? &snaps[p.snapshot] : NULL);
+            ++written;
+            continue;
+        }
+        if (p.snapshot >= 0)                                // ? Held for the next batch, with its snapshot
+        {
+            held_snaps.push_back(snaps[p.snapshot]);
+            p.snapshot = (int)held_snaps.size() - 1;
+        }
+        held.push_back(p);
+    }
+    pending.swap(held);
+    snaps.swap(held_snaps);
+
+    if (dropped > 0)
+    {
+        log_dropped += dropped;
+        text += "(The log writer fell behind: " + std::to_string(dropped) + " events were dropped here.)\n";
+    }
+    if (!text.empty())
+    {
+        fwrite(text.data(), 1, text.size(), stdout);
+        fflush(stdout);
+    }
+
+    return written;
+}
+
+/// @name log_writer
+/// @brief The background writer thread. Drains the rings until told to stop, then drains them one last time.
+/// @param param Unused
+/// @return NULL
+/// @note This function uses the following global variables:
+/// @note - log_running (from log.h): Whether the writer should keep going
+void *log_writer(void *param)
+{
+    (void)param;
+    timespec idle = { 0, LOG_IDLE_NS };
+
+    while (log_running.load(std::memory_order_acquire))
+    {
+        if (log_drain() == 0) nanosleep(&idle, NULL);
+    }
+    log_drain(true);
+
+    return NULL;
+}
+
+/// @name log_start
+/// @brief Starts the logging pipeline
+/// @param quiet If true, per-item output is skipped entirely and no writer thread is started
+/// @param snapshots Whether buffer snapshots will be logged
+/// @note This function uses the following global variables:
+/// @note - log_enabled, log_snapshots, log_running, log_thread, log_dropped (from log.h): The pipeline's state
+void log_start(bool quiet, bool snapshots)
+{
+    log_enabled = !quiet;
+    log_snapshots = snapshots;
+    log_dropped = 0;
+    if (!log_enabled) return;
+
+    log_running.store(true, std::memory_order_release);
+    pthread_create(&log_thread, NULL, log_writer, NULL);
+}
+
+/// @name log_stop
+/// @brief Stops the writer thread once every event logged so far has been written, then frees the rings.
+/// @brief Call this after the producer and consumer threads have been joined.
+/// @note This function uses the following global variables:
+/// @note - log_enabled, log_running, log_thread, log_rings (from log.h): The pipeline's state
+void log_stop()
+{
+    if (!log_enabled) return;
+
+    log_running.store(false, std::memory_order_release);
+    pthread_join(log_thread, NULL);
+    log_enabled = false;
+
+    pthread_mutex_lock(&log_registry_mutex);
+    for (log_ring* ring : log_rings)
+    {
+        delete[] ring->snapshots;
+        delete ring;
+    }
+    log_rings.clear();
+    pthread_mutex_unlock(&log_registry_mutex);
+}
+
+#endif // _LOG_H_DEFINED_
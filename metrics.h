@@ -0,0 +1,263 @@
+// **********************************************************
+// *
+// * Sam Young
+// * Operating Systems
+// * Programming Project 3: Process Synchronization
+// * March 14, 2025
+// * Dr. Siming Liu
+// *
+// **********************************************************
+
+#ifndef _METRICS_H_DEFINED_
+#define _METRICS_H_DEFINED_
+
+#define METRICS_DEFAULT_INTERVAL_MS 100     // ? How often the sampler reads the buffer unless --metrics-interval says otherwise
+#define METRICS_LINE_SIZE           512     // ? The longest sample line
+#define METRICS_FLUSH_TIMEOUT_MS    1000    // ? How long metrics_stop waits for a slow socket reader to take the last line
+
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <sys/un.h>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <atomic>
+#include "buffer.h"
+#include "stats.h"
+#include "log.h"
+
+int                 metrics_fd = -1;            // ? Where samples go: a file, or a connected Unix socket (-1 for nowhere)
+bool                metrics_socket = false;     // ? Whether metrics_fd is a socket (sent without blocking) or a file
+int                 metrics_interval_ms = METRICS_DEFAULT_INTERVAL_MS;  // ? The time between samples
+int                 metrics_run = 0;            // ? Which run the samples belong to (sweeps do many runs)
+long                metrics_dropped = 0;        // ? Samples a slow socket reader had no room for
+char                metrics_pending[METRICS_LINE_SIZE]; // ? The end of a line the socket only took part of, sent before the next one
+int                 metrics_pending_len = 0;    // ? How many bytes of it are left
+std::atomic<bool>   metrics_running(false);     // ? Tells the sampler thread to keep going
+std::atomic<int>    metrics_wake(0);            // ? A futex word bumped by metrics_stop, so the sampler doesn't finish its nap
+pthread_t           metrics_thread;             // ? The sampler thread
+
+/// @brief The counters one sample is compared against, to turn totals into rates
+struct metrics_counters
+{
+    uint64_t    time;       // ? When the counters were read (log_now nanoseconds)
+    long        produced;   // ? Items produced so far
+    long        consumed;   // ? Items consumed so far
+    long        full;       // ? Times a producer found the buffer full
+    long        empty;      // ? Times a consumer found the buffer empty
+};
+
+/// @name metrics_open
+/// @brief Picks where samples are written: a file (truncated), or "unix:<path>" for a Unix socket someone is
+/// @brief already listening on
+/// @param target The file or socket
+/// @return true on success, false if it couldn't be opened (errno says why)
+/// @note This function uses the following global variables:
+/// @note - metrics_fd, metrics_socket (from metrics.h): Where samples go
+bool metrics_open(const char* target)
+{
+    if (strncmp(target, "unix:", 5) == 0)
+    {
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(target + 5) >= sizeof(addr.sun_path))
+        {
+            errno = ENAMETOOLONG;
+            return false;
+        }
+        strcpy(addr.sun_path, target + 5);
+
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) return false;
+        if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+        {
+            int saved = errno;
+            close(fd);
+            errno = saved;
+            return false;
+        }
+        metrics_fd = fd;
+        metrics_socket = true;
+        return true;
+    }
+
+    metrics_fd = open(target, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    metrics_socket = false;
+    return metrics_fd >= 0;
+}
+
+/// @name metrics_flush
+/// @brief Sends as much of a partly sent line as the socket has room for, without blocking. A stream socket may take
+/// @brief only part of a line, so its end is held back and goes out before anything else, keeping lines whole.
+/// @return true once nothing is held back, false otherwise
+/// @note This function uses the following global variables:
+/// @note - metrics_fd, metrics_pending, metrics_pending_len (from metrics.h): The socket and what's left to send
+bool metrics_flush()
+{
+    while (metrics_pending_len > 0)
+    {
+        ssize_t sent = send(metrics_fd, metrics_pending, metrics_pending_len, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent <= 0) return false;
+        metrics_pending_len -= (int)sent;
+        memmove(metrics_pending, metrics_pending + sent, metrics_pending_len);
+    }
+    return true;
+}
+
+/// @name metrics_send
+/// @brief Sends one line to the socket without blocking: all of it, the start of it (holding back the rest for
+/// @brief metrics_flush), or none of it, if the reader hasn't taken the previous line yet or has no room at all
+/// @param line The line
+/// @param n Its length
+/// @return true if any of the line was sent, false if it was dropped
+/// @note This function uses the following global variables:
+/// @note - metrics_fd, metrics_pending, metrics_pending_len (from metrics.h): The socket and what's left to send
+bool metrics_send(const char* line, int n)
+{
+    if (!metrics_flush()) return false;
+
+    ssize_t sent = send(metrics_fd, line, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (sent <= 0) return false;
+    metrics_pending_len = n - (int)sent;
+    memcpy(metrics_pending, line + sent, metrics_pending_len);
+    return true;
+}
+
+/// @name metrics_read
+/// @brief Reads the counters a sample is built from. Everything here is an atomic load, so the sampler never takes
+/// @brief the buffer's lock or holds up a producer or consumer.
+/// @return The counters
+metrics_counters metrics_read()
+{
+    metrics_counters c;
+    c.time = log_now();
+    c.produced = stats_total(&thread_stats::produced);
+    c.consumed = stats_total(&thread_stats::consumed);
+    c.full = stats_total(&thread_stats::full);
+    c.empty = stats_total(&thread_stats::empty);
+    return c;
+}
+
+/// @name metrics_emit
+/// @brief Writes one JSON line describing the buffer now and the rates since the previous sample
+/// @param start When the run started (log_now nanoseconds)
+/// @param prev The counters from the previous sample
+/// @param now The counters just read
+/// @note This function uses the following global variables:
+/// @note - buffer_count, buffer_capacity, buffer_parked_* (from buffer.h): The buffer being sampled
+/// @note - metrics_fd, metrics_socket, metrics_run, metrics_dropped (from metrics.h): Where samples go
+void metrics_emit(uint64_t start, const metrics_counters& prev, const metrics_counters& now)
+{
+    double dt = (now.time - prev.time) / 1e9;
+    if (dt <= 0) dt = 1e-9;
+
+    char line[METRICS_LINE_SIZE];
+    int n = snprintf(line, sizeof(line),
+                     "{\"run\":%i,\"t\":%.6f,\"occupancy\":%i,\"capacity\":%i,\"produced\":%li,\"consumed\":%li,"
+                     "\"produce_rate\":%.1f,\"consume_rate\":%.1f,\"full_rate\":%.1f,\"empty_rate\":%.1f,"
+                     "\"blocked_producers\":%i,\"blocked_consumers\":%i,\"dropped\":%li}\n",
+                     metrics_run, (now.time - start) / 1e9, buffer_count(), buffer_capacity(),
+                     now.produced, now.consumed,
+                     (now.produced - prev.produced) / dt, (now.consumed - prev.consumed) / dt,
+                     (now.full - prev.full) / dt, (now.empty - prev.empty) / dt,
+                     buffer_parked_producers(), buffer_parked_consumers(), metrics_dropped);
+
+    if (metrics_socket)                                     // ? Never blocks on a slow reader; the sample is dropped whole instead
+    {
+        if (!metrics_send(line, n)) ++metrics_dropped;
+    }
+    else if (write(metrics_fd, line, n) != n)
+    {
+        ++metrics_dropped;
+    }
+}
+
+/// @name metrics_sampler
+/// @brief The sampler thread. Takes a sample every interval (on absolute deadlines, so the series doesn't drift)
+/// @brief until told to stop, then takes one last sample.
+/// @param param Unused
+/// @return NULL
+/// @note This function uses the following global variables:
+/// @note - metrics_running, metrics_wake, metrics_interval_ms (from metrics.h): When to sample and when to stop
+void *metrics_sampler(void *param)
+{
+    (void)param;
+    uint64_t interval = (uint64_t)metrics_interval_ms * 1000000ull;
+    metrics_counters prev = metrics_read();
+    uint64_t start = prev.time;
+    uint64_t deadline = start + interval;
+
+    while (metrics_running.load(std::memory_order_acquire))
+    {
+        int epoch = metrics_wake.load(std::memory_order_acquire);
+        uint64_t now = log_now();
+        if (now < deadline)
+        {
+            uint64_t left = deadline - now;
+            timespec wait = { (time_t)(left / 1000000000ull), (long)(left % 1000000000ull) };
+            if (metrics_running.load(std::memory_order_acquire)) queue_futex_wait(&metrics_wake, epoch, &wait);
+            continue;                                       // ? Woken early, or the deadline passed: check again
+        }
+
+        metrics_counters cur = metrics_read();
+        metrics_emit(start, prev, cur);
+        prev = cur;
+        deadline += interval;
+        if (deadline <= cur.time) deadline = cur.time + interval;  // ? Fell a whole interval behind, so skip ahead
+    }
+    metrics_emit(start, prev, metrics_read());
+
+    return NULL;
+}
+
+/// @name metrics_start
+/// @brief Starts sampling the buffer, if a metrics target was opened. Call it once the buffer and the stats slots
+/// @brief exist.
+/// @note This function uses the following global variables:
+/// @note - metrics_fd, metrics_running, metrics_thread, metrics_run (from metrics.h): The sampler's state
+void metrics_start()
+{
+    if (metrics_fd < 0) return;
+
+    ++metrics_run;
+    metrics_running.store(true, std::memory_order_release);
+    pthread_create(&metrics_thread, NULL, metrics_sampler, NULL);
+}
+
+/// @name metrics_stop
+/// @brief Stops the sampler right away (after its final sample). Call this after the producer and consumer threads
+/// @brief have been joined and before the buffer is destroyed. If the socket only took part of the last line, waits
+/// @brief up to METRICS_FLUSH_TIMEOUT_MS for the reader to make room for the rest.
+/// @note This function uses the following global variables:
+/// @note - metrics_fd, metrics_running, metrics_wake, metrics_thread (from metrics.h): The sampler's state
+/// @note - metrics_pending_len, metrics_dropped (from metrics.h): What's left to send, and what never was
+void metrics_stop()
+{
+    if (metrics_fd < 0 || !metrics_running.load(std::memory_order_acquire)) return;
+
+    metrics_running.store(false, std::memory_order_release);
+    metrics_wake.fetch_add(1, std::memory_order_release);
+    queue_futex_wake(&metrics_wake, 1);
+    pthread_join(metrics_thread, NULL);
+
+    uint64_t give_up = log_now() + METRICS_FLUSH_TIMEOUT_MS * 1000000ull;
+    while (!metrics_flush())
+    {
+        uint64_t now = log_now();
+        pollfd room = { metrics_fd, POLLOUT, 0 };
+        if (now >= give_up || poll(&room, 1, (int)((give_up - now) / 1000000ull) + 1) <= 0
+            || (room.revents & (POLLERR | POLLHUP)) != 0)
+        {
+            metrics_pending_len = 0;                        // ? The reader is stuck or gone: its last line stays cut short
+            ++metrics_dropped;
+            break;
+        }
+    }
+}
+
+#endif // _METRICS_H_DEFINED_
@@ -12,18 +12,81 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <signal.h>
+#include <sys/resource.h>
 #include <cstring>
-#include <unordered_map>
+#include <climits>
+#include <vector>
+#include <chrono>
 #include "buffer.h"
+#include "log.h"
+#include "stats.h"
+#include "histogram.h"
+#include "sweep.h"
+#include "affinity.h"
+#include "prime.h"
+#include "rng.h"
+#include "metrics.h"
+#include "pipeline.h"
+#include "loadgen.h"
+
+#define SHARDS_PER_PRODUCER -1          // ? The --shards setting that gives every producer its own shard
+
+/// @brief The settings a parameter sweep was asked for
+struct sweep_options
+{
+    std::vector<buffer_engine>  engines;        // ? The engines to try
+    std::vector<wait_policy>    waits;          // ? The wait policies to try
+    std::vector<int>            capacities;     // ? The capacities to try
+    std::vector<int>            batches;        // ? The batch sizes to try
+    int                         max_threads;    // ? The most producers or consumers in a mix
+    const char*                 csv_path;       // ? Where to write CSV (NULL for none)
+    const char*                 json_path;      // ? Where to write JSON (NULL for none)
+};
+
+/// @brief What main hands each producer and consumer thread
+struct thread_args
+{
+    int slot;       // ? The thread's counter slot (in stats.h)
+    int peers;      // ? How many threads share its role (they deal a trace's events out between them)
+    long quota;     // ? How many items a benchmark producer makes before stopping (0 for no limit)
+};
 
 void    *producer   (void *param);
 void    *consumer   (void *param);
-void    endLog      (int, int, int, int);
+void    *bench_producer(void *param);
+void    *bench_consumer(void *param);
+void    endLog      (int, int, int, int, double, double);
+void    pipelineLog (int, double, double);
+bool    parse_engine(const char*, buffer_engine*);
+bool    parse_wait  (const char*, wait_policy*);
+double  cpu_seconds ();
+double  run_simulation(buffer_engine, int, int, int, int, int, double*);
+double  run_pipeline(buffer_engine, int, const std::vector<pipeline_spec>&, int, double*);
+int     run_sweep   (const sweep_options&, int, int);
 
-std::unordered_map<pid_t, int> produced_counts; // ? A map for storing each thread's produced items count
-std::unordered_map<pid_t, int> consumed_counts; // ? A map for storing each thread's consumed items count
-bool execute = true;                            // ? A bool value for whether or not a thread should continue with execution.
+std::atomic<bool> execute(true);                // ? Whether or not a thread should continue with execution. Cleared by main to stop the run.
+bool drain = false;                             // ? On shutdown, lets the consumers take every item left in the buffer first
 bool buff_snap = false;                         // ? Handles buffer snapshot
+int batch_size = 1;                             // ? How many items a producer or consumer moves per buffer call
+wait_policy wait_mode = WAIT_ADAPTIVE;          // ? How threads wait on a full or empty buffer
+bool wait_given = false;                        // ? Whether --wait set wait_mode (otherwise it follows the engine)
+pin_policy pin_mode = PIN_NONE;                 // ? How threads are placed on CPUs
+std::vector<int> pin_list;                      // ? The CPUs to pin to, in thread order, when pin_mode is PIN_LIST
+int buffer_node = -1;                           // ? The NUMA node the buffer's memory ended up on (-1 if unknown)
+const char* shm_name = NULL;                    // ? The shared memory segment the buffer lives in (NULL for an in-process buffer)
+bool shm_produce = true;                        // ? Whether this process runs producers on the shared memory buffer
+bool shm_consume = true;                        // ? Whether this process runs consumers on the shared memory buffer
+int shard_setting = 0;                          // ? How many shards to split the buffer into (0 for one shared buffer, or SHARDS_PER_PRODUCER)
+std::vector<int> class_capacities;              // ? Each priority class's capacity, most urgent first (empty without priority mode)
+int item_range = 100;                           // ? Producers make items from 0 to item_range - 1
+uint64_t run_seed = 0;                          // ? The seed every thread's random number generator is derived from
+bool quiet = false;                             // ? Skips the per-item output entirely
+bool bench = false;                             // ? Runs the threads flat out and measures throughput and latency
+long bench_items = 0;                           // ? In benchmark mode, stops once this many items are consumed (0 to run for main_sleep)
+load_spec arrival_load;                         // ? How producers pace their inserts (in loadgen.h)
+load_spec service_load;                         // ? How long consumers spend on each item they remove
+bool arrival_given = false;                     // ? Whether --arrival set arrival_load (otherwise it follows the sleep argument)
+bool service_given = false;                     // ? Whether --service set service_load
 
 int main(int argc, char* argv[])
 {
@@ -33,15 +96,74 @@ int main(int argc, char* argv[])
     // ?    The number of producer threads
     // ?    The number of consumer threads
     // ?    Whether buffer snapshots should be displayed in the output
+    // ? Anything after those is an optional "--name=value" setting:
+    // ?    --engine=mutex|spsc|mpmc    Which buffer implementation to run (defaults to mutex)
+    // ?    --capacity=<int>            How many slots the buffer has (defaults to DEFAULT_BUFFER_SIZE)
+    // ?    --batch=<int>               How many items each producer/consumer moves per buffer call (defaults to 1)
+    // ?    --wait=adaptive|spin|park   How threads wait on a full or empty buffer: spin, then yield, then sleep until
+    // ?                                woken; busy-poll; or sleep right away (the original behavior). Defaults to
+    // ?                                park for the mutex engine and adaptive for the others and for --shm.
+    // ?    --pin=<policy>|<cpus>       Pins each thread to a CPU: "spread" (across sockets and cores), "socket" (all on
+    // ?                                one socket), "sibling" (each producer/consumer pair on one core's hardware
+    // ?                                threads), or a list like "0,2,4-7" in thread order (producers first).
+    // ?                                The buffer is allocated on the first consumer's NUMA node. Defaults to "none".
+    // ?    --shards=producers|cores|<int>  Splits the buffer into shards of --capacity slots each: one per producer,
+    // ?                                one per core, or a set number. Producer i and consumer i share home shard
+    // ?                                i % shards; a consumer whose shard is empty steals from the others.
+    // ?    --classes=<int>             Splits the buffer into this many priority classes, most urgent first, each its
+    // ?                                own queue of --capacity slots. Producers pick a class per insert (per batch).
+    // ?    --class-capacities=<list>   Each class's capacity instead, e.g. "16,256,4096"
+    // ?    --class-mix=<list>          How often producers pick each class, relative to the others (defaults to even)
+    // ?    --dequeue=strict|weighted   Whether consumers always take the most urgent class that has items (the
+    // ?                                default), or serve the classes in turn by weight so none starves
+    // ?    --weights=<list>            In weighted mode, how many removes each class gets per turn (defaults to
+    // ?                                K, K - 1, ..., 1 for K classes)
+    // ?    --shm=/<name>               Puts the buffer in a POSIX shared memory segment (created by whichever process
+    // ?                                gets there first) so producer and consumer processes can share it
+    // ?    --role=both|producer|consumer|remove  Which threads this process runs on the shared buffer (defaults to
+    // ?                                both), or "remove" to delete the segment, e.g. after a crash. With --drain,
+    // ?                                consumers keep going until no producer process is attached and the ring is empty.
+    // ?    --arrival=<pattern>         How producers pace their inserts (each insert, or batch, is one arrival):
+    // ?                                "fixed:<gap>", "poisson:<mean gap>", "onoff:<gap>,<on>,<off>" (bursts of
+    // ?                                arrivals a gap apart, then silence), "uniform:<low>,<high>" (a think time),
+    // ?                                "trace:<path>" (one gap per line, dealt out between the producers) or "none".
+    // ?                                Times take ns, us, ms or s, e.g. "poisson:20us". Defaults to uniform:1s,<max>s
+    // ?                                from the second argument (none when benchmarking).
+    // ?    --service=<pattern>         How long a consumer spends on each item it removes, in the same form
+    // ?    --range=<int>               Producers make items from 0 up to this (defaults to 100)
+    // ?    --seed=<int>                Seeds the threads' random numbers, so a run can be repeated (defaults to the time)
+    // ?    --drain                     On shutdown, stops the producers first and lets the consumers empty the buffer
+    // ?    --quiet                     Skips the per-item output, leaving only the ending log
+    // ?    --bench                     Benchmark mode: no sleeping, no per-item output, and latency percentiles in the log
+    // ?    --items=<int>               Benchmark until this many items have been consumed instead of for main_sleep seconds
+    // ?    --sweep                     Benchmarks every combination below for main_sleep seconds each, ignoring the
+    // ?                                producer/consumer counts, and writes the results as CSV (stdout by default)
+    // ?    --engines=<list>            Engines to sweep, e.g. "mutex,mpmc" (defaults to all of them)
+    // ?    --waits=<list>              Wait policies to sweep, e.g. "spin,park" (defaults to --wait, or each engine's default)
+    // ?    --capacities=<list>         Capacities to sweep, e.g. "64,1024,65536" (defaults to --capacity)
+    // ?    --batches=<list>            Batch sizes to sweep (defaults to --batch)
+    // ?    --max-threads=<int>         The most producers or consumers to sweep up to (defaults to the core count)
+    // ?    --csv=<path>, --json=<path> Where to write the sweep's results
+    // ?    --metrics=<path>            Samples the buffer while it runs and writes JSON lines to a file, or to a
+    // ?                                listening Unix socket with "unix:<path>" (a line the reader has no room for
+    // ?                                is dropped whole and counted in the log)
+    // ?    --metrics-interval=<int>    Milliseconds between samples (defaults to METRICS_DEFAULT_INTERVAL_MS)
+    // ?    --pipeline=<stages>         Runs a chain of queues instead, ignoring the producer/consumer counts, e.g.
+    // ?                                "gen:2,filter:2,agg:1" (stage:threads; "gen" first, "agg" last, "filter"
+    // ?                                or "pass" between). Threads run flat out for main_sleep seconds, then the
+    // ?                                pipeline drains stage by stage.
     // ? This just makes sure that the function recieves all the required arguments
-    if(argc != 6)
+    if(argc < 6)
     {
-        printf("\u001b[37;1m%s: \u001b[31;1mUsage:\u001b[0m %s <int> <int> <int> <int> <\"yes\"/\"no\">\n", argv[0], argv[0]);
+        printf("\u001b[37;1m%s: \u001b[31;1mUsage:\u001b[0m %s <int> <int> <int> <int> <\"yes\"/\"no\"> [--engine=mutex|spsc|mpmc] [--capacity=<int>] [--batch=<int>] [--wait=adaptive|spin|park]\n"
+               "\t[--pin=none|spread|socket|sibling|<cpus>] [--shards=producers|cores|<int>] [--classes=<int>] [--class-capacities=<list>] [--class-mix=<list>] [--dequeue=strict|weighted] [--weights=<list>]\n"
+               "\t[--shm=/<name>] [--role=both|producer|consumer|remove] [--range=<int>] [--seed=<int>] [--drain] [--quiet] [--bench] [--items=<int>] [--sweep] [--engines=<list>] [--waits=<list>] [--capacities=<list>] [--batches=<list>] [--max-threads=<int>] [--csv=<path>] [--json=<path>]\n"
+               "\t[--metrics=<path>|unix:<path>] [--metrics-interval=<int>] [--pipeline=<stage>:<int>,...] [--arrival=<pattern>] [--service=<pattern>]\n", argv[0], argv[0]);
 
         return 1;
     }
 
-    srand(time(NULL));      // ? Generates a seed for rand() to use
+    run_seed = (uint64_t)time(NULL);    // ? The default seed, reported by endLog so the run can be repeated with --seed
     
     // ? Initializes all the required variables
     int main_sleep      = atoi(argv[1]);
@@ -79,76 +201,721 @@ int main(int argc, char* argv[])
     }
     else
     {
-        printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m Last argument must be \"yes\" or \"no\"\n", argv[0]);
+        printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m Fifth argument must be \"yes\" or \"no\"\n", argv[0]);
         return 0;
     }
+
+    // ? Reads the optional settings
+    buffer_engine selected = ENGINE_MUTEX;
+    int capacity = DEFAULT_BUFFER_SIZE;
+    bool sweep = false;
+    std::vector<pipeline_spec> pipeline;
+    int class_count = 0;
+    bool class_strict = true;
+    std::vector<int> class_weights, class_mix;
+    sweep_options sweep_opts = { {}, {}, {}, {}, (int)sysconf(_SC_NPROCESSORS_ONLN), NULL, NULL };
+    for (int i = 6; i < argc; ++i)
+    {
+        if (strncmp(argv[i], "--engine=", 9) == 0)
+        {
+            if (!parse_engine(argv[i] + 9, &selected))
+            {
+                printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --engine must be \"mutex\", \"spsc\" or \"mpmc\"\n", argv[0]);
+                return 0;
+            }
+        }
+        else if (strncmp(argv[i], "--capacity=", 11) == 0)
+        {
+            capacity = atoi(argv[i] + 11);
+            if (capacity < 1 || capacity > SEM_VALUE_MAX)
+            {
+                printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --capacity must be between 1 and %i\n", argv[0], SEM_VALUE_MAX);
+                return 0;
+            }
+        }
+        else if (strncmp(argv[i], "--batch=", 8) == 0)
+        {
+            batch_size = atoi(argv[i] + 8);
+            if (batch_size < 1)
+            {
+                printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --batch must be at least 1\n", argv[0]);
+                return 0;
+            }
+        }
+        else if (strncmp(argv[i], "--wait=", 7) == 0)
+        {
+            if (!parse_wait(argv[i] + 7, &wait_mode))
+            {
+                printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --wait must be \"adaptive\", \"spin\" or \"park\"\n", argv[0]);
+                return 0;
+            }
+            wait_given = true;
+        }
+        else if (strncmp(argv[i], "--pin=", 6) == 0)
+        {
+            if (!affinity_parse(argv[i] + 6, &pin_mode, &pin_list))
+            {
+                printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --pin must be \"none\", \"spread\", \"socket\", \"sibling\" or a CPU list\n", argv[0]);
+                return 0;
+            }
+            std::vector<cpu_info> topology = affinity_topology();
+            for (int cpu : pin_list)
+            {
+                if (affinity_find(topology, cpu) == NULL)
+                {
+                    printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --pin names CPU %i, which this process can't run on\n", argv[0], cpu);
+                    return 0;
+                }
+            }
+        }
+        else if (strncmp(argv[i], "--shards=", 9) == 0)
+        {
+            const char* value = argv[i] + 9;
+            if      (strcasecmp(value, "producers") == 0) shard_setting = SHARDS_PER_PRODUCER;
+            else if (strcasecmp(value, "cores") == 0)     shard_setting = (int)sysconf(_SC_NPROCESSORS_ONLN);
+            else                                          shard_setting = atoi(value);
+            if (shard_setting == 0 || shard_setting < SHARDS_PER_PRODUCER)
+            {
+                printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --shards must be \"producers\", \"cores\" or at least 1\n", argv[0]);
+                return 0;
+            }
+        }
+        else if (strncmp(argv[i], "--classes=", 10) == 0)
+        {
+            class_count = atoi(argv[i] + 10);
+            if (class_count < 1)
+            {
+                printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --classes must be at least 1\n", argv[0]);
+                return 0;
+            }
+        }
+        else if (strncmp(argv[i], "--class-capacities=", 19) == 0)
+        {
+            if (!parse_int_list(argv[i] + 19, &class_capacities))
+            {
+                printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --class-capacities must be a list of positive integers\n", argv[0]);
+                return 0;
+            }
+        }
+        else if (strncmp(argv[i], "--class-mix=", 12) == 0)
+        {
+            if (!parse_int_list(argv[i] + 12, &class_mix))
+            {
+                printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --class-mix must be a list of positive integers\n", argv[0]);
+                return 0;
+            }
+        }
+        else if (strncmp(argv[i], "--dequeue=", 10) == 0)
+        {
+            const char* order = argv[i] + 10;
+            if      (strcasecmp(order, "strict") == 0)   class_strict = true;
+            else if (strcasecmp(order, "weighted") == 0) class_strict = false;
+            else
+            {
+                printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --dequeue must be \"strict\" or \"weighted\"\n", argv[0]);
+                return 0;
+            }
+        }
+        else if (strncmp(argv[i], "--weights=", 10) == 0)
+        {
+            if (!parse_int_list(argv[i] + 10, &class_weights))
+            {
+                printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --weights must be a list of positive integers\n", argv[0]);
+                return 0;
+            }
+        }
+        else if (strncmp(argv[i], "--shm=", 6) == 0)
+        {
+            shm_name = argv[i] + 6;
+            if (shm_name[0] != '/' || shm_name[1] == '\0' || strchr(shm_name + 1, '/') != NULL)
+            {
+                printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --shm must be a name like \"/osproj4\"\n", argv[0]);
+                return 0;
+            }
+        }
+        else if (strncmp(argv[i], "--role=", 7) == 0)
+        {
+            const char* role = argv[i] + 7;
+            if      (strcasecmp(role, "both") == 0)     { shm_produce = true;  shm_consume = true; }
+            else if (strcasecmp(role, "producer") == 0) { shm_produce = true;  shm_consume = false; }
+            else if (strcasecmp(role, "consumer") == 0) { shm_produce = false; shm_consume = true; }
+            else if (strcasecmp(role, "remove") == 0)   { shm_produce = false; shm_consume = false; }
+            else
+            {
+                printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --role must be \"both\", \"producer\", \"consumer\" or \"remove\"\n", argv[0]);
+                return 0;
+            }
+        }
+        else if (strncmp(argv[i], "--arrival=", 10) == 0 || strncmp(argv[i], "--service=", 10) == 0)
+        {
+            bool arrival = argv[i][2] == 'a';
+            std::string error;
+            if (!load_parse(argv[i] + 10, arrival ? &arrival_load : &service_load, &error))
+            {
+                printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --%s %s\n", argv[0], arrival ? "arrival" : "service", error.c_str());
+                return 0;
+            }
+            (arrival ? arrival_given : service_given) = true;
+        }
+        else if (strncmp(argv[i], "--range=", 8) == 0)
+        {
+            item_range = atoi(argv[i] + 8);
+            if (item_range < 1)
+            {
+                printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --range must be at least 1\n", argv[0]);
+                return 0;
+            }
+        }
+        else if (strncmp(argv[i], "--seed=", 7) == 0)
+        {
+            char* end;
+            run_seed = strtoull(argv[i] + 7, &end, 0);
+            if (end == argv[i] + 7 || *end != '\0')
+            {
+                printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --seed must be an integer\n", argv[0]);
+                return 0;
+            }
+        }
+        else if (strcmp(argv[i], "--drain") == 0)
+        {
+            drain = true;
+        }
+        else if (strcmp(argv[i], "--quiet") == 0)
+        {
+            quiet = true;
+        }
+        else if (strcmp(argv[i], "--bench") == 0)
+        {
+            bench = true;
+        }
+        else if (strncmp(argv[i], "--items=", 8) == 0)
+        {
+            bench = true;
+            bench_items = atol(argv[i] + 8);
+            if (bench_items < 1)
+            {
+                printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --items must be at least 1\n", argv[0]);
+                return 0;
+            }
+        }
+        else if (strcmp(argv[i], "--sweep") == 0)
+        {
+            sweep = true;
+        }
+        else if (strncmp(argv[i], "--engines=", 10) == 0)
+        {
+            sweep_opts.engines.clear();
+            std::string list = argv[i] + 10;
+            for (size_t start = 0; start <= list.size(); )
+            {
+                size_t end = list.find(',', start);
+                if (end == std::string::npos) end = list.size();
+                buffer_engine e;
+                if (!parse_engine(list.substr(start, end - start).c_str(), &e))
+                {
+                    printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --engines must list \"mutex\", \"spsc\" or \"mpmc\"\n", argv[0]);
+                    return 0;
+                }
+                sweep_opts.engines.push_back(e);
+                start = end + 1;
+            }
+        }
+        else if (strncmp(argv[i], "--waits=", 8) == 0)
+        {
+            sweep_opts.waits.clear();
+            std::string list = argv[i] + 8;
+            for (size_t start = 0; start <= list.size(); )
+            {
+                size_t end = list.find(',', start);
+                if (end == std::string::npos) end = list.size();
+                wait_policy w;
+                if (!parse_wait(list.substr(start, end - start).c_str(), &w))
+                {
+                    printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --waits must list \"adaptive\", \"spin\" or \"park\"\n", argv[0]);
+                    return 0;
+                }
+                sweep_opts.waits.push_back(w);
+                start = end + 1;
+            }
+        }
+        else if (strncmp(argv[i], "--capacities=", 13) == 0)
+        {
+            if (!parse_int_list(argv[i] + 13, &sweep_opts.capacities))
+            {
+                printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --capacities must be a comma-separated list of positive integers\n", argv[0]);
+                return 0;
+            }
+        }
+        else if (strncmp(argv[i], "--batches=", 10) == 0)
+        {
+            if (!parse_int_list(argv[i] + 10, &sweep_opts.batches))
+            {
+                printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --batches must be a comma-separated list of positive integers\n", argv[0]);
+                return 0;
+            }
+        }
+        else if (strncmp(argv[i], "--max-threads=", 14) == 0)
+        {
+            sweep_opts.max_threads = atoi(argv[i] + 14);
+            if (sweep_opts.max_threads < 1)
+            {
+                printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --max-threads must be at least 1\n", argv[0]);
+                return 0;
+            }
+        }
+        else if (strncmp(argv[i], "--csv=", 6) == 0)
+        {
+            sweep_opts.csv_path = argv[i] + 6;
+        }
+        else if (strncmp(argv[i], "--json=", 7) == 0)
+        {
+            sweep_opts.json_path = argv[i] + 7;
+        }
+        else if (strncmp(argv[i], "--metrics=", 10) == 0)
+        {
+            if (!metrics_open(argv[i] + 10))
+            {
+                printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --metrics couldn't open \"%s\": %s\n", argv[0], argv[i] + 10, strerror(errno));
+                return 0;
+            }
+        }
+        else if (strncmp(argv[i], "--pipeline=", 11) == 0)
+        {
+            if (!pipeline_parse(argv[i] + 11, &pipeline))
+            {
+                printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --pipeline must list stages like \"gen:2,filter:2,agg:1\" (gen first, agg last)\n", argv[0]);
+                return 0;
+            }
+        }
+        else if (strncmp(argv[i], "--metrics-interval=", 19) == 0)
+        {
+            metrics_interval_ms = atoi(argv[i] + 19);
+            if (metrics_interval_ms < 1)
+            {
+                printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --metrics-interval must be at least 1\n", argv[0]);
+                return 0;
+            }
+        }
+        else
+        {
+            printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m Unknown option \"%s\"\n", argv[0], argv[i]);
+            return 0;
+        }
+    }
+    prime_initialize((uint32_t)item_range);    // ? Sieves every item a producer can make (in prime.h)
+    if (shm_name != NULL && (sweep || !pipeline.empty() || shard_setting != 0))
+    {
+        printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --shm can't be combined with --sweep, --pipeline or --shards\n", argv[0]);
+        return 0;
+    }
+    if (class_count == 0 && (!class_capacities.empty() || !class_mix.empty() || !class_weights.empty()))
+    {
+        class_count = std::max(class_capacities.size(), std::max(class_mix.size(), class_weights.size()));
+    }
+    if (class_count > 0)                            // ? Priority mode: one queue per class
+    {
+        if (shm_name != NULL || sweep || !pipeline.empty() || shard_setting != 0)
+        {
+            printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --classes can't be combined with --shm, --sweep, --pipeline or --shards\n", argv[0]);
+            return 0;
+        }
+        if (class_capacities.empty()) class_capacities.assign(class_count, capacity);
+        if (class_mix.empty()) class_mix.assign(class_count, 1);
+        if (class_weights.empty())
+        {
+            for (int c = 0; c < class_count; ++c) class_weights.push_back(class_count - c);
+        }
+        if ((int)class_capacities.size() != class_count || (int)class_mix.size() != class_count || (int)class_weights.size() != class_count)
+        {
+            printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --class-capacities, --class-mix and --weights need one entry per class (%i)\n", argv[0], class_count);
+            return 0;
+        }
+        buffer_set_classes(class_strict, class_weights, class_mix);
+    }
+    if (shm_name != NULL && !shm_produce && !shm_consume)  // ? --role=remove
+    {
+        if (!shm_ring<buffer_item>::remove(shm_name))
+        {
+            printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m Couldn't remove \"%s\": %s\n", argv[0], shm_name, strerror(errno));
+            return 0;
+        }
+        printf("Removed %s\n", shm_name);
+        return 0;
+    }
+    if ((arrival_given || service_given) && (sweep || !pipeline.empty()))
+    {
+        printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --arrival and --service can't be combined with --sweep or --pipeline\n", argv[0]);
+        return 0;
+    }
+    if (!wait_given)                                // ? The shared memory ring is its own engine, not the mutex one
+    {
+        wait_mode = (shm_name != NULL) ? WAIT_ADAPTIVE : queue_default_wait(selected);
+    }
+    if (sweep)
+    {
+        if (sweep_opts.engines.empty()) sweep_opts.engines = { ENGINE_MUTEX, ENGINE_SPSC, ENGINE_MPMC };
+        if (sweep_opts.waits.empty() && wait_given) sweep_opts.waits = { wait_mode };
+        if (sweep_opts.capacities.empty()) sweep_opts.capacities = { capacity };
+        if (sweep_opts.batches.empty()) sweep_opts.batches = { batch_size };
+        return run_sweep(sweep_opts, main_sleep, thread_maxsleep);
+    }
+    if (!pipeline.empty())
+    {
+        for (size_t s = 0; s + 1 < pipeline.size(); ++s)
+        {
+            if (selected == ENGINE_SPSC && (pipeline[s].threads > 1 || pipeline[s + 1].threads > 1))
+            {
+                printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m The spsc engine allows at most one thread on each side of every queue\n", argv[0]);
+                return 0;
+            }
+        }
+        if (metrics_fd >= 0)
+        {
+            printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --metrics samples the single buffer and can't be used with --pipeline\n", argv[0]);
+            return 0;
+        }
+
+        printf("Starting pipeline...\n");
+        double cpu;
+        double elapsed = run_pipeline(selected, capacity, pipeline, main_sleep, &cpu);
+        pipelineLog(main_sleep, elapsed, cpu);
+        return 0;
+    }
+    if (selected == ENGINE_SPSC && (prod_threads > 1 || cons_threads > 1))
+    {
+        printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m The spsc engine allows at most one producer and one consumer thread\n", argv[0]);
+        return 0;
+    }
+    if (shm_name != NULL)                           // ? Each process only runs the threads its role calls for
+    {
+        if (!shm_produce) prod_threads = 0;
+        if (!shm_consume) cons_threads = 0;
+    }
+    if (bench_items > 0 && (cons_threads < 1 || (prod_threads < 1 && shm_name == NULL)))
+    {
+        printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m --items needs at least one producer and one consumer thread\n", argv[0]);
+        return 0;
+    }
+    if (shm_name != NULL)
+    {
+        std::string error;
+        if (!buffer_attach_shm(shm_name, capacity, wait_mode, prod_threads > 0, &error))
+        {
+            printf("\u001b[37;1m%s: \u001b[31;1mError:\u001b[0m Couldn't attach to \"%s\": %s\n", argv[0], shm_name, error.c_str());
+            return 0;
+        }
+    }
     
+    printf("Starting threads...\n");
+
+    // ? Runs the producers and consumers
+    double cpu;
+    double elapsed = run_simulation(selected, capacity, prod_threads, cons_threads, thread_maxsleep, main_sleep, &cpu);
+
+    // ? Produces the ending log to spec
+    endLog(main_sleep, thread_maxsleep, prod_threads, cons_threads, elapsed, cpu);
+    buffer_detach_shm();
+
+    // ? Returns successful
+    return 0;
+}
+
+/// @name run_simulation
+/// @brief Runs one simulation: sets up the buffer, starts the producer and consumer threads, lets them run for
+/// @brief main_sleep seconds (or until a benchmark's item count is consumed), then stops and joins them.
+/// @param selected The buffer engine
+/// @param capacity The buffer's capacity
+/// @param prod_threads The number of producer threads
+/// @param cons_threads The number of consumer threads
+/// @param thread_maxsleep The longest think time the threads take between items, unless --arrival or --service said otherwise
+/// @param main_sleep How long to let the threads run, in seconds
+/// @param cpu Where to store how much CPU time the process used while the threads ran, in seconds
+/// @return How long the threads actually ran, in seconds
+/// @note This function makes use of the global variables:
+/// @note - execute (from project3.cpp): Whether the threads should continue execution
+/// @note - arrival_load, service_load, arrival_given, service_given (from project3.cpp): How the threads are paced
+/// @note - drain (from project3.cpp): Whether the consumers empty the buffer before stopping
+/// @note - wait_mode (from project3.cpp): How threads wait on a full or empty buffer
+/// @note - pin_mode, pin_list (from project3.cpp): How threads are placed on CPUs
+/// @note - buffer_node (from project3.cpp): Set to the NUMA node the buffer was allocated on
+/// @note - shard_setting (from project3.cpp): How many shards to split the buffer into
+/// @note - class_capacities (from project3.cpp): Each priority class's capacity, in priority mode
+/// @note - bench, bench_items (from project3.cpp): Whether this is a benchmark, and its item count
+/// @note - quiet, buff_snap (from project3.cpp): What output the threads should produce
+double run_simulation(buffer_engine selected, int capacity, int prod_threads, int cons_threads, int thread_maxsleep, int main_sleep, double* cpu)
+{
     // ? Initializes our pthreads
     pthread_attr_t attr;
     pthread_t tid[prod_threads + cons_threads];
 
-    printf("Starting threads...\n");
-    
-    // ? Initializes our buffer (in buffer.h)
-    buffer_initialize();
+    execute.store(true);
+
+    // ? Without --arrival or --service, the threads think for 1 to thread_maxsleep seconds between items, as the
+    // ? original sleep did (benchmarks run flat out instead)
+    if (!arrival_given) arrival_load = load_uniform_seconds(bench ? 0 : thread_maxsleep);
+    if (!service_given) service_load = load_uniform_seconds(bench ? 0 : thread_maxsleep);
+
+    // ? Picks a CPU for every thread (in affinity.h)
+    std::vector<int> cpus;
+    affinity_plan(pin_mode, pin_list, affinity_topology(), prod_threads, cons_threads, &cpus);
+
+    // ? Initializes our buffer (in buffer.h) and a counter slot for every thread (in stats.h).
+    // ? When threads are pinned, the buffer is created from the first consumer's CPU. Its slots are freshly mapped
+    // ? pages touched right there (in queue.h), so the kernel's first-touch policy puts them on the consumer's NUMA
+    // ? node. A shared memory buffer was already attached by main.
+    int home = (cons_threads > 0) ? prod_threads : 0;
+    int shards = (shard_setting == SHARDS_PER_PRODUCER) ? std::max(prod_threads, 1) : shard_setting;
+    if (buffer_shm == NULL && pin_mode != PIN_NONE && home < (int)cpus.size())
+    {
+        cpu_set_t saved;
+        affinity_pin_self(cpus[home], &saved);
+        buffer_initialize(selected, capacity, wait_mode, shards, class_capacities);
+        affinity_restore_self(&saved);
+    }
+    else if (buffer_shm == NULL)
+    {
+        buffer_initialize(selected, capacity, wait_mode, shards, class_capacities);
+    }
+    buffer_node = affinity_node_of(buffer_memory());
+    stats_initialize(prod_threads, cons_threads, (int)class_capacities.size());
+    std::vector<thread_args> args(prod_threads + cons_threads);
+    for (int i = 0; i < prod_threads + cons_threads; ++i)
+    {
+        args[i].slot = i;
+        args[i].peers = (i < prod_threads) ? prod_threads : cons_threads;
+        args[i].quota = 0;
+    }
+    for (int i = 0; i < prod_threads && bench_items > 0; ++i)  // ? Splits a benchmark's item count between the producers
+    {
+        args[i].quota = bench_items / prod_threads + (i < bench_items % prod_threads ? 1 : 0);
+    }
+
+    // ? Starts the background thread that prints what the producers and consumers log (in log.h), and the one that
+    // ? samples the buffer if --metrics was given (in metrics.h)
+    log_start(quiet || bench, buff_snap);
+    metrics_start();
 
     // ? Initializes thread attributes
     pthread_attr_init(&attr);
+    double cpu_start = cpu_seconds();
 
     // ? Creates our producer threads
     for (int i = 0; i < prod_threads; ++i)
     {
-        pthread_create(&tid[i], &attr, producer, (void*)&thread_maxsleep);  // ? Passes thread_maxsleep as the variable to the runner
+        if (pin_mode != PIN_NONE) affinity_set(&attr, cpus[i]);                             // ? Pins the thread before it ever runs
+        stats_slots[i].cpu = cpus[i];
+        pthread_create(&tid[i], &attr, bench ? bench_producer : producer, (void*)&args[i]);  // ? Passes the thread's arguments to the runner
     }
     
     // ? Creates our consumer threads
     for (int i = 0; i < cons_threads; ++i)
     {
-        pthread_create(&tid[prod_threads + i], &attr, consumer, (void*)&thread_maxsleep);   // ? Passes thread_maxsleep as the variable to the runner
+        if (pin_mode != PIN_NONE) affinity_set(&attr, cpus[prod_threads + i]);
+        stats_slots[prod_threads + i].cpu = cpus[prod_threads + i];
+        pthread_create(&tid[prod_threads + i], &attr, bench ? bench_consumer : consumer, (void*)&args[prod_threads + i]);  // ? Passes the thread's arguments to the runner
     }
 
     // ? Sleeps the main thread for the specified length of time (passed by the user).
-    // ? This returns 0 on successful execution, so I just set execute's value to this.
-    execute = sleep(main_sleep);
+    // ? The wall time is measured so the log can report throughput.
+    auto start = std::chrono::steady_clock::now();
+    // ? A benchmark with an item count instead waits until the consumers have seen every item.
+    if (bench_items > 0)
+    {
+        timespec poll = { 0, 1000000 };
+        while (stats_total(&thread_stats::consumed) < bench_items) nanosleep(&poll, NULL);
+    }
+    else
+    {
+        sleep(main_sleep);
+    }
 
-    // ? Sends a signal to cancel thread execution
-    for (int i = 0; i < prod_threads + cons_threads; ++i)
+    // ? Tells every thread to stop after what it's doing now (a paced thread notices within LOAD_SLICE_NS)
+    execute.store(false);
+
+    // ? To drain, the producers are joined first (the consumers keep making room for any that are blocked), and
+    // ? only then is the buffer closed, so the consumers leave once they've taken the last item.
+    // ? Otherwise the buffer is closed right away, which wakes every blocked thread so it can see the stop.
+    bool draining = drain && cons_threads > 0;
+    if (draining)
+    {
+        for (int i = 0; i < prod_threads; ++i)
+        {
+            pthread_join(tid[i], NULL);
+        }
+    }
+    // ? A shared memory buffer only closes once every producer process is done, so stopping consumers also has to
+    // ? tell them not to wait for that.
+    buffer_close();
+    if (!draining) buffer_stop();
+    for (int i = draining ? prod_threads : 0; i < prod_threads + cons_threads; ++i)
     {
-        pthread_cancel(tid[i]);
+        pthread_join(tid[i], NULL);
     }
 
-    // ? Joins every thread to the main process if it wasn't canceled (was in a sensitive area)
-    for (int i = 0; i < prod_threads + cons_threads; ++i)
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    *cpu = cpu_seconds() - cpu_start;
+
+    // ? Takes the last sample, then lets the log writer print everything that was logged and stops it
+    metrics_stop();
+    log_stop();
+
+    return elapsed.count();
+}
+
+/// @name run_pipeline
+/// @brief Runs a pipeline: sets up its stages and queues, starts every stage's threads, samples the queues while
+/// @brief they run for main_sleep seconds, then stops the generators and waits for the rest to drain.
+/// @param selected The engine every queue runs with
+/// @param capacity Every queue's capacity
+/// @param specs The stages
+/// @param main_sleep How long to let the generators run, in seconds
+/// @param cpu Where to store how much CPU time the process used while the threads ran, in seconds
+/// @return How long the threads actually ran (including the drain), in seconds
+/// @note This function makes use of the global variables:
+/// @note - execute (from project3.cpp): Cleared to stop the generators
+/// @note - wait_mode (from project3.cpp): How threads wait on a full or empty queue
+double run_pipeline(buffer_engine selected, int capacity, const std::vector<pipeline_spec>& specs, int main_sleep, double* cpu)
+{
+    execute.store(true);
+
+    // ? Initializes the queues and stages (in pipeline.h), with a counter slot for every thread (in stats.h)
+    pipeline_initialize(specs, selected, capacity, wait_mode);
+    std::vector<pipeline_args> args;
+    for (int s = 0; s < (int)specs.size(); ++s)
+    {
+        for (int i = 0; i < specs[s].threads; ++i)
+        {
+            args.push_back({ s, (int)args.size() });
+        }
+    }
+    std::vector<pthread_t> tid(args.size());
+
+    double cpu_start = cpu_seconds();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < args.size(); ++i)
+    {
+        pthread_create(&tid[i], NULL, pipeline_worker, (void*)&args[i]);
+    }
+
+    // ? Instead of sleeping straight through, main samples every queue's occupancy once a millisecond
+    auto stop_at = start + std::chrono::seconds(main_sleep);
+    timespec poll = { 0, 1000000 };
+    while (std::chrono::steady_clock::now() < stop_at)
+    {
+        pipeline_sample();
+        nanosleep(&poll, NULL);
+    }
+
+    // ? Stops the generators. Each stage closes the queue below it once its last thread is done, so joining every
+    // ? thread waits for the pipeline to drain.
+    execute.store(false);
+    for (size_t i = 0; i < tid.size(); ++i)
     {
         pthread_join(tid[i], NULL);
     }
 
-    // ? Produces the ending log to spec
-    endLog(main_sleep, thread_maxsleep, prod_threads, cons_threads);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    *cpu = cpu_seconds() - cpu_start;
+    return elapsed.count();
+}
 
-    // ? Returns successful
-    return 0;
+/// @name run_sweep
+/// @brief Benchmarks every configuration in a sweep, one after another, and writes the results as CSV and/or JSON.
+/// @brief Progress goes to stderr so stdout can be redirected straight into a file.
+/// @param opts What to sweep and where to write it
+/// @param main_sleep How long to run each configuration, in seconds
+/// @param thread_maxsleep Passed through to the threads (benchmark threads aren't paced)
+/// @return 0 on success, 1 if an output file couldn't be written
+/// @note This function makes use of the global variables:
+/// @note - bench, batch_size, wait_mode, buff_snap (from project3.cpp): Set for each configuration
+int run_sweep(const sweep_options& opts, int main_sleep, int thread_maxsleep)
+{
+    std::vector<sweep_point> points = sweep_points(opts.engines, opts.waits, opts.capacities, opts.batches, opts.max_threads);
+    std::vector<sweep_result> results;
+
+    bench = true;
+    buff_snap = false;
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        const sweep_point& p = points[i];
+        batch_size = p.batch;
+        wait_mode = p.wait;
+        fprintf(stderr, "sweep %zu/%zu: %s %s %i:%i capacity %i batch %i ... ", i + 1, points.size(),
+                engine_name(p.engine), wait_policy_name(p.wait), p.producers, p.consumers, p.capacity, p.batch);
+
+        sweep_result r;
+        r.point = p;
+        r.elapsed = run_simulation(p.engine, p.capacity, p.producers, p.consumers, thread_maxsleep, main_sleep, &r.cpu);
+        r.produced = stats_total(&thread_stats::produced);
+        r.consumed = stats_total(&thread_stats::consumed);
+        r.throughput = r.elapsed > 0 ? r.consumed / r.elapsed : 0.0;
+
+        latency_histogram latency;
+        stats_latency(&latency);
+        r.p50 = histogram_percentile(&latency, 50.0);
+        r.p99 = histogram_percentile(&latency, 99.0);
+        r.p999 = histogram_percentile(&latency, 99.9);
+        r.max = latency.max;
+        results.push_back(r);
+
+        fprintf(stderr, "%.0f items/sec\n", r.throughput);
+    }
+
+    int status = 0;
+    if (opts.csv_path == NULL && opts.json_path == NULL) sweep_write_csv(stdout, results);
+    if (opts.csv_path != NULL)
+    {
+        FILE* out = fopen(opts.csv_path, "w");
+        if (out == NULL) { perror(opts.csv_path); status = 1; }
+        else { sweep_write_csv(out, results); fclose(out); }
+    }
+    if (opts.json_path != NULL)
+    {
+        FILE* out = fopen(opts.json_path, "w");
+        if (out == NULL) { perror(opts.json_path); status = 1; }
+        else { sweep_write_json(out, results); fclose(out); }
+    }
+
+    return status;
 }
 
 /// @name producer
-/// @brief Produces a random integer and then places it in the buffer if space allows.
-/// @param param The length of the maximum time this thread can sleep, passed as a void*
+/// @brief Produces a random integer and then places it in the buffer if space allows, at the times the arrival
+/// @brief pattern says. With a batch size above 1, produces that many integers at a time and inserts them in one call.
+/// @param param The thread's thread_args, passed as a void*
 /// @return NULL
-/// @note This function makes use of the global variable:
+/// @note This function makes use of the global variables:
 /// @note - execute (from project3.cpp): A bool of whether the thread should continue execution
+/// @note - batch_size (from project3.cpp): How many items to insert per buffer call
+/// @note - arrival_load (from project3.cpp): When to insert
 void *producer(void *param)
 {
-    int* sleep_len = (int*)param;       // ? We convert the sleep length from void* to int*
-    buffer_item item;                   // ? And create a new buffer item for item generation
+    thread_args* args = (thread_args*)param;
+    stats_register(args->slot);         // ? Binds this thread to its counters
+    rng_seed(run_seed, args->slot);     // ? And gives it its own stream of random numbers
+    load_pacer pacer;                   // ? And starts its arrivals (in loadgen.h)
+    load_start(&pacer, &arrival_load, my_stats->index - 1, args->peers);
+    buffer_item item;                   // ? And creates a new buffer item for item generation
+    std::vector<buffer_item> items(batch_size);
+
+    while(execute && batch_size > 1)    // ? The batched loop: fill a whole batch, then insert it at once
+    {
+        if (load_arrive(&pacer) == 0) break;
+        rng_fill(items.data(), batch_size, item_range);
+        if ( buffer_insert_items(items.data(), batch_size) != batch_size )
+        {
+            break;                      // ? The buffer was closed, so the run is over
+        }
+    }
 
-    while(execute)                      // ? While the main thread wants execution to be continuing
-    {                                   // ? Sleep for a random amount of time and generate a random number
-        if(*sleep_len != 0) sleep(std::rand() % (*sleep_len) + 1);
-        item = std::rand() % 100;
-        // ? If the insert item function fails, something went wrong, so we log it.
+    while(execute && batch_size == 1)   // ? While the main thread wants execution to be continuing
+    {                                   // ? Wait for the next arrival and generate a random number
+        if (load_arrive(&pacer) == 0) break;
+        item = rng_below(item_range);
+        // ? If the insert fails, the buffer was closed, so the run is over.
         if ( !buffer_insert_item(item) )
         {
-            std::cerr << "\u001b[36mProducer\u001b[0m: Could not insert item " << item << '\n';
+            break;
         }
     }
 
@@ -156,67 +923,413 @@ void *producer(void *param)
 }
 
 /// @name consumer
-/// @brief Consumes an integer in the buffer if available. Also detects if the consumed integer is prime.
-/// @param param The length of the maximum time this thread can sleep, passed as a void*
+/// @brief Consumes an integer in the buffer if available, then spends the service time on it. Also detects if the
+/// @brief consumed integer is prime, after the buffer has been released, and counts it in this thread's own slot.
+/// @param param The thread's thread_args, passed as a void*
 /// @return NULL
-/// @note This function makes use of the global variable:
+/// @note This function makes use of the global variables:
 /// @note - execute (from project3.cpp): A bool of whether the thread should continue execution
+/// @note - drain (from project3.cpp): Whether to keep going until the buffer is closed and empty
+/// @note - batch_size (from project3.cpp): The most items to remove per buffer call
+/// @note - service_load (from project3.cpp): How long to spend on each item
+/// @note - my_stats (from stats.h): This thread's counters
 void *consumer(void *param)
 {
-    int* sleep_len = (int*)param;           // ? We convert the sleep length from void* to int*
+    thread_args* args = (thread_args*)param;
+    stats_register(args->slot);             // ? Binds this thread to its counters
+    rng_seed(run_seed, args->slot);         // ? And gives it its own stream of random numbers
+    load_pacer pacer;                       // ? And starts its service times (in loadgen.h)
+    load_start(&pacer, &service_load, my_stats->index - 1, args->peers);
+    std::vector<buffer_item> items(batch_size);
 
-    while(execute)                          // ? While the main thread wants execution to be continuing
+    while((execute || drain) && batch_size > 1)     // ? The batched loop: take whatever is there, up to a whole batch
     {
-        if (*sleep_len != 0) sleep(rand() % (*sleep_len) + 1);   // ? Sleep for a random amount of time
-        
-        if( !buffer_remove_item() )         // ? If the item couldn't be removed, log the error
+        int n = buffer_remove_items(items.data(), batch_size);
+        if( n < 1 )
         {
-            std::cerr << "\u001b[35mConsumer\u001b[0m: Could not read item...\n";
+            break;                          // ? The buffer was closed and is empty, so the run is over
         }
+        stat_add(my_stats->primes, prime_count(items.data(), n));   // ? Classifies the whole batch at once
+        if (execute) load_serve(&pacer, n);                         // ? A draining consumer doesn't take its service time
+    }
+
+    while((execute || drain) && batch_size == 1)    // ? While the main thread wants execution to be continuing
+    {
+        buffer_item item;
+        if( !buffer_remove_item(&item) )    // ? If no item could be removed, the buffer was closed and is empty
+        {
+            break;
+        }
+        if (prime_is(item))
+        {
+            stat_add(my_stats->primes, 1);
+        }
+        if (execute) load_serve(&pacer, 1); // ? Spend the service time on it
     }
 
     return NULL;                            // ? Return NULL to end the thread
 }
 
+/// @name bench_stamp
+/// @brief Gets the current time in the form benchmark items carry it
+/// @return The steady clock in nanoseconds (the same clock in every process, so shared-memory runs compare too)
+inline buffer_item bench_stamp()
+{
+    return (buffer_item)log_now();
+}
+
+/// @name bench_producer
+/// @brief A benchmark producer: inserts batches of timestamped items as fast as the buffer accepts them, or at the
+/// @brief times the arrival pattern says.
+/// @param param The thread's thread_args, passed as a void*
+/// @return NULL
+/// @note This function makes use of the global variables:
+/// @note - execute (from project3.cpp): A bool of whether the thread should continue execution
+/// @note - batch_size (from project3.cpp): How many items to insert per buffer call
+/// @note - arrival_load (from project3.cpp): When to insert
+void *bench_producer(void *param)
+{
+    thread_args* args = (thread_args*)param;
+    stats_register(args->slot);
+    rng_seed(run_seed, args->slot);         // ? Draws arrival gaps, and picks priority classes in priority mode
+    load_pacer pacer;
+    load_start(&pacer, &arrival_load, my_stats->index - 1, args->peers);
+    std::vector<buffer_item> items(batch_size);
+    long left = args->quota;                // ? Counts down to zero when the producer has a quota
+
+    while (execute && (args->quota == 0 || left > 0))
+    {
+        int n = (args->quota != 0 && left < batch_size) ? (int)left : batch_size;
+        uint64_t due = load_arrive(&pacer);
+        if (due == 0) break;
+        // ? The whole batch is stamped with the time it was due, so time spent blocked on a full buffer (or behind
+        // ? schedule) counts as queueing delay instead of hiding it
+        buffer_item stamp = (buffer_item)due;
+        for (int i = 0; i < n; ++i)
+        {
+            items[i] = stamp;
+        }
+        if (buffer_insert_items(items.data(), n) != n) break;   // ? The buffer was closed
+        left -= n;
+    }
+
+    return NULL;
+}
+
+/// @name bench_consumer
+/// @brief A benchmark consumer: removes items as fast as they arrive and records how long each one waited.
+/// @param param The thread's thread_args, passed as a void*
+/// @return NULL
+/// @note This function makes use of the global variables:
+/// @note - execute (from project3.cpp): A bool of whether the thread should continue execution
+/// @note - drain (from project3.cpp): Whether to keep going until the buffer is closed and empty
+/// @note - batch_size (from project3.cpp): The most items to remove per buffer call
+/// @note - service_load (from project3.cpp): How long to spend on each item
+/// @note - my_stats (from stats.h): This thread's counters and latency histograms
+void *bench_consumer(void *param)
+{
+    thread_args* args = (thread_args*)param;
+    stats_register(args->slot);
+    rng_seed(run_seed, args->slot);
+    load_pacer pacer;
+    load_start(&pacer, &service_load, my_stats->index - 1, args->peers);
+    std::vector<buffer_item> items(batch_size);
+
+    while (execute || drain)
+    {
+        int cls = 0;
+        int n = buffer_remove_items(items.data(), batch_size, &cls);
+        if (n == 0) break;                  // ? The buffer was closed and is empty
+        buffer_item now = bench_stamp();
+        for (int i = 0; i < n; ++i)
+        {
+            uint64_t waited = (now > items[i]) ? (uint64_t)(now - items[i]) : 0;
+            histogram_record(&my_stats->latency, waited);
+            if (my_stats->class_latency != NULL) histogram_record(&my_stats->class_latency[cls], waited);
+        }
+        if (execute) load_serve(&pacer, n);
+    }
+
+    return NULL;
+}
+
+/// @name parse_engine
+/// @brief Turns an engine name from the command line into a buffer_engine.
+/// @param name The name given by the user ("mutex", "spsc" or "mpmc", any case)
+/// @param out Where to store the engine if the name is recognized
+/// @return true if the name was recognized, false otherwise
+bool parse_engine(const char* name, buffer_engine* out)
+{
+    if      (strcasecmp(name, "mutex") == 0) *out = ENGINE_MUTEX;
+    else if (strcasecmp(name, "spsc")  == 0) *out = ENGINE_SPSC;
+    else if (strcasecmp(name, "mpmc")  == 0) *out = ENGINE_MPMC;
+    else return false;
+
+    return true;
+}
+
+/// @name parse_wait
+/// @brief Turns a wait policy name from the command line into a wait_policy.
+/// @param name The name given by the user ("adaptive", "spin" or "park", any case)
+/// @param out Where to store the policy if the name is recognized
+/// @return true if the name was recognized, false otherwise
+bool parse_wait(const char* name, wait_policy* out)
+{
+    if      (strcasecmp(name, "adaptive") == 0) *out = WAIT_ADAPTIVE;
+    else if (strcasecmp(name, "spin")     == 0) *out = WAIT_SPIN;
+    else if (strcasecmp(name, "park")     == 0) *out = WAIT_PARK;
+    else return false;
+
+    return true;
+}
+
+/// @name cpu_seconds
+/// @brief Gets how much CPU time (user + system) the whole process has used so far
+/// @return The CPU time, in seconds
+double cpu_seconds()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
 /// @name endLog
 /// @brief Outputs a log of the simulation to stdout.
 /// @param main_sleep The length of the main thread's sleep time
 /// @param thread_sleep The maximum length that a thread may sleep
 /// @param prod_count The number of producer threads
 /// @param cons_count The number of consumer threads
+/// @param elapsed How long the threads ran for, in seconds
+/// @param cpu How much CPU time the process used while they ran, in seconds
 /// @note This function makes use of the following global variables:
-/// @note - `consumed_counts`   (from project3.cpp): A map of how many integers each thread read.
-/// @note - `produced_counts`   (from project3.cpp): A map of how many integers each thread produced.
-/// @note - `consumed_count`    (from buffer.h): A count of how many integers were read.
-/// @note - `produced_count`    (from buffer.h): A count of how many integers were created.
-/// @note - `BUFFER_SIZE`       (from buffer.h): The size of the buffer.
-/// @note - `empty_count`       (from buffer.h): A count of how many times the buffer was empty.
-/// @note - `full_count`        (from buffer.h): A count of how many times the buffer was full.
-/// @note - `count`             (from buffer.h): A count of how many items are currently stored in the buffer.
-void endLog(int main_sleep, int thread_sleep, int prod_count, int cons_count)
+/// @note - `stats_slots`       (from stats.h): Each thread's counters, labeled by role.
+/// @note - `buffer_size`       (from buffer.h): The size of the buffer.
+/// @note - `engine`            (from buffer.h): The engine the buffer ran with.
+/// @note - `buffer_shard_count`, `buffer_shard_totals` (from buffer.h): The shards and their counts, in sharded mode.
+/// @note - `buffer_classes`, `buffer_class_count`, `buffer_class_totals`, `buffer_class_strict`, `buffer_class_weights`
+/// @note   (from buffer.h): The priority classes, their counts and how they were served, in priority mode.
+/// @note - `buffer_shm`        (from buffer.h): The shared memory ring, in shared-memory mode.
+/// @note - `shm_name`          (from project3.cpp): The shared memory segment's name.
+/// @note - `arrival_load`, `service_load` (from project3.cpp): How the producers and consumers were paced.
+/// @note - `wait_mode`         (from project3.cpp): How threads waited on a full or empty buffer.
+/// @note - `pin_mode`          (from project3.cpp): How threads were placed on CPUs.
+/// @note - `buffer_node`       (from project3.cpp): The NUMA node the buffer was allocated on.
+/// @note - `run_seed`          (from project3.cpp): The seed the threads' random numbers came from.
+/// @note - `drain`             (from project3.cpp): Whether the consumers emptied the buffer before stopping.
+/// @note - `batch_size`        (from project3.cpp): How many items moved per buffer call.
+/// @note - `bench`             (from project3.cpp): Whether to add the benchmark's latency percentiles.
+/// @note - `metrics_fd`, `metrics_dropped` (from metrics.h): Whether samples were written, and how many were dropped.
+/// @note - `log_dropped`       (from log.h): Output events dropped because the log writer fell behind.
+void endLog(int main_sleep, int thread_sleep, int prod_count, int cons_count, double elapsed, double cpu)
 {
     printf("PRODUCER / CONSUMER SIMULATION COMPLETE\n");
     printf("=======================================\n");
     printf("Simulation Time:                     %i\n", main_sleep);
     printf("Maximum Thread Sleep Time:           %i\n", thread_sleep);
+    printf("Arrival pattern:                     %s\n", arrival_load.pattern == LOAD_NONE ? "none" : arrival_load.source.c_str());
+    printf("Service pattern:                     %s\n", service_load.pattern == LOAD_NONE ? "none" : service_load.source.c_str());
     printf("Number of Producer Threads:          %i\n", prod_count);
     printf("Number of Consumer Threads:          %i\n", cons_count);
-    printf("Size of buffer:                      %i\n", BUFFER_SIZE);
+    printf("Size of buffer:                      %i\n", buffer_size);
+    printf("Buffer engine:                       %s\n", engine_name(engine));
+    if (buffer_shard_count > 0) printf("Buffer shards:                       %i\n", buffer_shard_count);
+    if (buffer_class_count > 0)
+    {
+        printf("Priority classes:                    %i (%s", buffer_class_count, buffer_class_strict ? "strict" : "weighted");
+        for (int c = 0; !buffer_class_strict && c < buffer_class_count; ++c) printf("%s%i", c == 0 ? " " : ":", buffer_class_weights[c]);
+        printf(")\n");
+    }
+    if (buffer_shm != NULL)
+    {
+        printf("Shared memory segment:               %s (%s, creator pid %i)\n", shm_name,
+               buffer_shm->created() ? "created" : "attached", (int)buffer_shm->creator());
+        printf("Processes attached:                  %i\n", buffer_shm->attached());
+    }
+    printf("Batch size:                          %i\n", batch_size);
+    printf("Random seed:                         %llu\n", (unsigned long long)run_seed);
+    printf("Wait policy:                         %s\n", wait_policy_name(wait_mode));
+    printf("Thread placement:                    %s\n", pin_policy_name(pin_mode));
+    if (buffer_node >= 0) printf("Buffer NUMA node:                    %i", buffer_node);
+    else                  printf("Buffer NUMA node:                    unknown");
+    if (pin_mode != PIN_NONE && buffer_shm == NULL && cons_count > 0)  // ? Says so when first-touch placement didn't take
+    {
+        std::vector<cpu_info> topology = affinity_topology();
+        const cpu_info* home = affinity_find(topology, stats_slots[prod_count].cpu);
+        if (home != NULL && buffer_node >= 0 && home->node != buffer_node) printf(" (not the first consumer's node, %i)", home->node);
+    }
     printf("\n");
-    printf("Total Number of Items Produced:      %i\n", produced_count);
-    int i = 1;
-    for (auto& entry : produced_counts)
+    if (pin_mode != PIN_NONE)
     {
-        printf("\tThread %i:                    %i\n", i++, entry.second);
+        std::vector<cpu_info> topology = affinity_topology();
+        for (int i = 0; i < stats_slot_count; ++i)
+        {
+            const cpu_info* c = affinity_find(topology, stats_slots[i].cpu);
+            if (c == NULL) continue;
+            printf("\t%s %-3i (%i):       cpu %i (core %i, socket %i, node %i)\n",
+                   stats_slots[i].role == ROLE_PRODUCER ? "Producer" : "Consumer", stats_slots[i].index,
+                   stats_slots[i].tid, c->cpu, c->core, c->socket, c->node);
+        }
     }
     printf("\n");
-    printf("Total Number of Items Consumed:      %i\n", consumed_count);
-    for (auto& entry : consumed_counts)
+    long consumed = stats_total(&thread_stats::consumed);
+    printf("Total Number of Items Produced:      %li\n", stats_total(&thread_stats::produced));
+    for (int i = 0; i < stats_slot_count; ++i)
     {
-        printf("\tThread %i:                    %i\n", i++, entry.second);
+        if (stats_slots[i].role != ROLE_PRODUCER) continue;
+        printf("\tProducer %-3i (%i):       %li\n", stats_slots[i].index, stats_slots[i].tid, stats_slots[i].produced.load());
     }
     printf("\n");
-    printf("Number Of Items Remaining in Buffer: %i\n", count);
-    printf("Number Of Times Buffer Was Full:     %i\n", full_count);
-    printf("Number Of Times Buffer Was Empty:    %i\n", empty_count);
-}
\ No newline at end of file
+    printf("Total Number of Items Consumed:      %li\n", consumed);
+    for (int i = 0; i < stats_slot_count; ++i)
+    {
+        if (stats_slots[i].role != ROLE_CONSUMER) continue;
+        printf("\tConsumer %-3i (%i):       %li\n", stats_slots[i].index, stats_slots[i].tid, stats_slots[i].consumed.load());
+    }
+    printf("\n");
+    if (!bench)
+    {
+        printf("Total Number of Primes Consumed:     %li\n", stats_total(&thread_stats::primes));
+        for (int i = 0; i < stats_slot_count; ++i)
+        {
+            if (stats_slots[i].role != ROLE_CONSUMER) continue;
+            printf("\tConsumer %-3i (%i):       %li\n", stats_slots[i].index, stats_slots[i].tid, stats_slots[i].primes.load());
+        }
+        printf("\n");
+    }
+    if (buffer_shard_count > 0)
+    {
+        printf("Items Per Shard (in / out / left):\n");
+        for (int i = 0; i < buffer_shard_count; ++i)
+        {
+            printf("\tShard %-3i                   %li / %li / %i\n", i + 1, buffer_shard_totals[i].inserted.load(),
+                   buffer_shard_totals[i].removed.load(), buffer_shards[i]->size());
+        }
+        printf("\n");
+        printf("Total Number of Steals:              %li\n", stats_total(&thread_stats::steals));
+        for (int i = 0; i < stats_slot_count; ++i)
+        {
+            if (stats_slots[i].role != ROLE_CONSUMER) continue;
+            printf("\tConsumer %-3i (%i):       %li\n", stats_slots[i].index, stats_slots[i].tid, stats_slots[i].steals.load());
+        }
+        printf("\n");
+    }
+    if (buffer_class_count > 0)
+    {
+        printf("Items Per Class (in / out / left / capacity):\n");
+        for (int c = 0; c < buffer_class_count; ++c)
+        {
+            printf("\tClass %-3i                   %li / %li / %i / %i\n", c + 1, buffer_class_totals[c].inserted.load(),
+                   buffer_class_totals[c].removed.load(), buffer_classes[c]->size(), buffer_classes[c]->capacity());
+        }
+        printf("\n");
+    }
+    long lost = stats_total(&thread_stats::produced) - consumed - buffer_count();
+    printf("Shutdown:                            %s\n", drain ? "drain" : "stop");
+    printf("Number Of Items Remaining in Buffer: %i\n", buffer_count());
+    if (buffer_shm == NULL)                         // ? Other processes' items pass through a shared buffer too
+    {
+        printf("Number Of Items Lost:                %li\n", lost);
+    }
+    printf("Number Of Times Buffer Was Full:     %li\n", stats_total(&thread_stats::full));
+    printf("Number Of Times Buffer Was Empty:    %li\n", stats_total(&thread_stats::empty));
+    printf("Throughput (items consumed/sec):     %.0f\n", elapsed > 0 ? consumed / elapsed : 0.0);
+    if (metrics_fd >= 0)
+    {
+        printf("Metrics Samples Dropped:             %li\n", metrics_dropped);
+    }
+    if (log_dropped > 0)
+    {
+        printf("Log Events Dropped:                  %li\n", log_dropped);
+    }
+
+    if (bench)
+    {
+        latency_histogram latency;
+        stats_latency(&latency);
+        printf("\n");
+        printf("BENCHMARK LATENCY (insert to remove)\n");
+        printf("Elapsed Time (sec):                  %.3f\n", elapsed);
+        printf("CPU Time (sec):                      %.3f\n", cpu);
+        printf("CPU Used (cores):                    %.2f\n", elapsed > 0 ? cpu / elapsed : 0.0);
+        printf("Items Measured:                      %lu\n", (unsigned long)latency.total);
+        printf("p50 (ns):                            %lu\n", (unsigned long)histogram_percentile(&latency, 50.0));
+        printf("p99 (ns):                            %lu\n", (unsigned long)histogram_percentile(&latency, 99.0));
+        printf("p99.9 (ns):                          %lu\n", (unsigned long)histogram_percentile(&latency, 99.9));
+        printf("max (ns):                            %lu\n", (unsigned long)latency.max);
+        if (buffer_class_count > 0)
+        {
+            printf("Per Class (items / p50 / p99 / p99.9 / max ns):\n");
+            for (int c = 0; c < buffer_class_count; ++c)
+            {
+                stats_class_latency(c, &latency);
+                printf("\tClass %-3i                   %lu / %lu / %lu / %lu / %lu\n", c + 1, (unsigned long)latency.total,
+                       (unsigned long)histogram_percentile(&latency, 50.0), (unsigned long)histogram_percentile(&latency, 99.0),
+                       (unsigned long)histogram_percentile(&latency, 99.9), (unsigned long)latency.max);
+            }
+        }
+    }
+}
+
+/// @name pipelineLog
+/// @brief Outputs a log of a pipeline run to stdout: each stage's throughput, each queue's occupancy, and the stage
+/// @brief that looks like the bottleneck.
+/// @param main_sleep How long the generators ran, in seconds
+/// @param elapsed How long the threads ran (including the drain), in seconds
+/// @param cpu How much CPU time the process used while they ran, in seconds
+/// @note This function makes use of the following global variables:
+/// @note - `pipeline_stages`, `pipeline_queues`, `pipeline_occupancies` (from pipeline.h): The pipeline.
+/// @note - `wait_mode`, `run_seed`, `batch_size` (from project3.cpp): The run's settings.
+void pipelineLog(int main_sleep, double elapsed, double cpu)
+{
+    printf("PIPELINE SIMULATION COMPLETE\n");
+    printf("============================\n");
+    printf("Simulation Time:                     %i\n", main_sleep);
+    printf("Number of Stages:                    %i\n", pipeline_stage_count);
+    printf("Size of each queue:                  %i\n", pipeline_queues[0]->capacity());
+    printf("Buffer engine:                       %s\n", engine_name(pipeline_queues[0]->engine()));
+    printf("Batch size:                          %i\n", batch_size);
+    printf("Random seed:                         %llu\n", (unsigned long long)run_seed);
+    printf("Wait policy:                         %s\n", wait_policy_name(wait_mode));
+    printf("\n");
+
+    for (int s = 0; s < pipeline_stage_count; ++s)
+    {
+        long in = pipeline_stage_total(s, &thread_stats::consumed);
+        long out = pipeline_stage_total(s, &thread_stats::produced);
+        printf("Stage %i: %s x%i\n", s + 1, pipeline_kind_name(pipeline_stages[s].kind), pipeline_stages[s].threads);
+        if (s > 0)
+        {
+            printf("\tItems In:                   %li (%.0f/sec)\n", in, elapsed > 0 ? in / elapsed : 0.0);
+        }
+        if (s + 1 < pipeline_stage_count)
+        {
+            printf("\tItems Out:                  %li (%.0f/sec)\n", out, elapsed > 0 ? out / elapsed : 0.0);
+        }
+        else
+        {
+            printf("\tPrimes Seen:                %li\n", pipeline_stage_total(s, &thread_stats::primes));
+        }
+
+        if (s + 1 < pipeline_stage_count)
+        {
+            const pipeline_occupancy& o = pipeline_occupancies[s];
+            double samples = o.samples > 0 ? (double)o.samples : 1.0;
+            printf("Queue %i: %s -> %s\n", s + 1, pipeline_kind_name(pipeline_stages[s].kind), pipeline_kind_name(pipeline_stages[s + 1].kind));
+            printf("\tMean Occupancy:             %.1f of %i (%.0f%%)\n", (double)o.total / samples,
+                   pipeline_queues[s]->capacity(), 100.0 * pipeline_fill(s));
+            printf("\tMax Occupancy:              %i\n", o.max);
+            printf("\tSampled Full / Empty:       %.0f%% / %.0f%%\n", 100.0 * o.full / samples, 100.0 * o.empty / samples);
+            printf("\tTimes Left Full / Empty:    %li / %li\n", pipeline_stage_total(s, &thread_stats::full),
+                   pipeline_stage_total(s + 1, &thread_stats::empty));
+        }
+    }
+    printf("\n");
+
+    int bottleneck = pipeline_bottleneck();
+    printf("Bottleneck Stage:                    %i (%s)\n", bottleneck + 1, pipeline_kind_name(pipeline_stages[bottleneck].kind));
+    printf("Throughput (items aggregated/sec):   %.0f\n",
+           elapsed > 0 ? pipeline_stage_total(pipeline_stage_count - 1, &thread_stats::consumed) / elapsed : 0.0);
+    printf("Elapsed Time (sec):                  %.3f\n", elapsed);
+    printf("CPU Time (sec):                      %.3f\n", cpu);
+    printf("CPU Used (cores):                    %.2f\n", elapsed > 0 ? cpu / elapsed : 0.0);
+}
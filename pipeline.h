@@ -0,0 +1,350 @@
+// **********************************************************
+// *
+// * Sam Young
+// * Operating Systems
+// * Programming Project 3: Process Synchronization
+// * March 14, 2025
+// * Dr. Siming Liu
+// *
+// **********************************************************
+
+#ifndef _PIPELINE_H_DEFINED_
+#define _PIPELINE_H_DEFINED_
+
+#include <pthread.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <strings.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include "queue.h"
+#include "stats.h"
+#include "prime.h"
+#include "rng.h"
+#include "buffer.h"
+
+/// @brief What a pipeline stage does with the items that pass through it
+enum pipeline_kind
+{
+    STAGE_GENERATE,     // ? Makes random items (the first stage only)
+    STAGE_FILTER,       // ? Passes on only the prime items
+    STAGE_FORWARD,      // ? Passes on every item unchanged
+    STAGE_AGGREGATE     // ? Counts the items and the primes among them (the last stage only)
+};
+
+/// @brief One stage as the command line described it
+struct pipeline_spec
+{
+    pipeline_kind   kind;       // ? What the stage does
+    int             threads;    // ? How many threads run it
+};
+
+/// @brief One stage of a running pipeline. Stage s reads from queue s - 1 and writes to queue s.
+struct pipeline_stage
+{
+    pipeline_kind       kind;       // ? What the stage does
+    int                 threads;    // ? How many threads run it
+    int                 first_slot; // ? Its threads' counter slots (in stats.h) start here
+    std::atomic<int>    running;    // ? Threads still running; the last one to leave closes the queue downstream
+};
+
+/// @brief How full one queue was, from main's samples while the pipeline ran
+struct pipeline_occupancy
+{
+    long    samples;    // ? How many times the queue was sampled
+    long    total;      // ? The sum of its occupancy over those samples
+    long    full;       // ? Samples where it was full
+    long    empty;      // ? Samples where it was empty
+    int     max;        // ? The highest occupancy seen
+};
+
+/// @brief What main hands each pipeline thread
+struct pipeline_args
+{
+    int stage;  // ? The stage the thread runs
+    int slot;   // ? The thread's counter slot (in stats.h)
+};
+
+pipeline_stage*                 pipeline_stages = NULL;     // ? The stages, created by pipeline_initialize
+int                             pipeline_stage_count = 0;   // ? How many stages there are
+bounded_queue<buffer_item>**    pipeline_queues = NULL;     // ? The queues between them (one fewer than the stages)
+pipeline_occupancy*             pipeline_occupancies = NULL;    // ? One per queue
+
+extern std::atomic<bool> execute;       // ? Whether the run should continue (from project3.cpp)
+extern int batch_size;                  // ? The most items a thread moves per queue call (from project3.cpp)
+extern int item_range;                  // ? Generated items run from 0 to item_range - 1 (from project3.cpp)
+extern uint64_t run_seed;               // ? The seed every thread's random numbers come from (from project3.cpp)
+
+/// @name pipeline_kind_name
+/// @brief Gets the name the command line uses for a stage
+/// @param k The stage's kind
+/// @return Its name
+const char* pipeline_kind_name(pipeline_kind k)
+{
+    switch (k)
+    {
+        case STAGE_GENERATE:    return "gen";
+        case STAGE_FILTER:      return "filter";
+        case STAGE_FORWARD:     return "pass";
+        default:                return "agg";
+    }
+}
+
+/// @name pipeline_parse
+/// @brief Reads a --pipeline setting: a comma-separated list of "<stage>:<threads>", e.g. "gen:2,filter:2,agg:1".
+/// @brief The first stage must be "gen" and the last "agg"; the ones between are "filter" or "pass".
+/// @param text The setting
+/// @param out Where to store the stages
+/// @return true if the setting was understood, false otherwise
+bool pipeline_parse(const char* text, std::vector<pipeline_spec>* out)
+{
+    out->clear();
+    std::string list = text;
+    for (size_t start = 0; start <= list.size(); )
+    {
+        size_t end = list.find(',', start);
+        if (end == std::string::npos) end = list.size();
+        std::string item = list.substr(start, end - start);
+        start = end + 1;
+
+        size_t colon = item.find(':');
+        if (colon == std::string::npos) return false;
+        std::string name = item.substr(0, colon);
+        char* stop;
+        long threads = strtol(item.c_str() + colon + 1, &stop, 10);
+        if (*stop != '\0' || stop == item.c_str() + colon + 1 || threads < 1) return false;
+
+        pipeline_spec spec;
+        spec.threads = (int)threads;
+        if      (strcasecmp(name.c_str(), "gen")    == 0) spec.kind = STAGE_GENERATE;
+        else if (strcasecmp(name.c_str(), "filter") == 0) spec.kind = STAGE_FILTER;
+        else if (strcasecmp(name.c_str(), "pass")   == 0) spec.kind = STAGE_FORWARD;
+        else if (strcasecmp(name.c_str(), "agg")    == 0) spec.kind = STAGE_AGGREGATE;
+        else return false;
+        out->push_back(spec);
+    }
+
+    if (out->size() < 2 || out->front().kind != STAGE_GENERATE || out->back().kind != STAGE_AGGREGATE) return false;
+    for (size_t s = 1; s + 1 < out->size(); ++s)
+    {
+        if ((*out)[s].kind != STAGE_FILTER && (*out)[s].kind != STAGE_FORWARD) return false;
+    }
+    return true;
+}
+
+/// @name pipeline_initialize
+/// @brief Creates the stages and the queues between them, replacing any earlier pipeline, and a counter slot for
+/// @brief every thread (in stats.h). Each queue has its own lock or indices, so a full queue only holds up the
+/// @brief stage feeding it, and that backpressure reaches the generators one stage at a time.
+/// @param specs The stages
+/// @param selected The engine every queue runs with
+/// @param capacity Every queue's capacity
+/// @param policy How threads wait on a full or empty queue
+/// @note This function uses the following global variables:
+/// @note - pipeline_stages, pipeline_stage_count, pipeline_queues, pipeline_occupancies (from pipeline.h): The pipeline
+void pipeline_initialize(const std::vector<pipeline_spec>& specs, buffer_engine selected, int capacity, wait_policy policy)
+{
+    for (int q = 0; q + 1 < pipeline_stage_count; ++q)
+    {
+        delete pipeline_queues[q];
+    }
+    delete[] pipeline_queues;
+    delete[] pipeline_stages;
+    delete[] pipeline_occupancies;
+
+    pipeline_stage_count = (int)specs.size();
+    pipeline_stages = new pipeline_stage[pipeline_stage_count];
+    pipeline_queues = new bounded_queue<buffer_item>*[pipeline_stage_count - 1];
+    pipeline_occupancies = new pipeline_occupancy[pipeline_stage_count - 1];
+
+    int slots = 0;
+    for (int s = 0; s < pipeline_stage_count; ++s)
+    {
+        pipeline_stages[s].kind = specs[s].kind;
+        pipeline_stages[s].threads = specs[s].threads;
+        pipeline_stages[s].first_slot = slots;
+        pipeline_stages[s].running.store(specs[s].threads, std::memory_order_relaxed);
+        slots += specs[s].threads;
+    }
+    for (int q = 0; q + 1 < pipeline_stage_count; ++q)
+    {
+        pipeline_queues[q] = new bounded_queue<buffer_item>(selected, capacity, policy);
+        memset(&pipeline_occupancies[q], 0, sizeof(pipeline_occupancy));
+    }
+    stats_initialize(slots, 0);
+}
+
+/// @name pipeline_sample
+/// @brief Adds one sample of every queue's occupancy. Only reads each queue's size, so it never takes a lock.
+/// @note This function uses the following global variables:
+/// @note - pipeline_stage_count, pipeline_queues, pipeline_occupancies (from pipeline.h): The pipeline
+void pipeline_sample()
+{
+    for (int q = 0; q + 1 < pipeline_stage_count; ++q)
+    {
+        int size = pipeline_queues[q]->size();
+        pipeline_occupancy& o = pipeline_occupancies[q];
+        ++o.samples;
+        o.total += size;
+        if (size >= pipeline_queues[q]->capacity()) ++o.full;
+        if (size == 0) ++o.empty;
+        if (size > o.max) o.max = size;
+    }
+}
+
+/// @name pipeline_stage_total
+/// @brief Adds up one counter over a stage's threads
+/// @param s The stage
+/// @param field The counter
+/// @return The total
+/// @note This function uses the following global variables:
+/// @note - pipeline_stages (from pipeline.h): The stages
+/// @note - stats_slots (from stats.h): Each thread's counters
+long pipeline_stage_total(int s, std::atomic<long> thread_stats::*field)
+{
+    long total = 0;
+    for (int i = 0; i < pipeline_stages[s].threads; ++i)
+    {
+        total += (stats_slots[pipeline_stages[s].first_slot + i].*field).load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+/// @name pipeline_fill
+/// @brief Gets how full a queue was on average, as a fraction of its capacity
+/// @param q The queue
+/// @return The fraction, from 0 to 1
+/// @note This function uses the following global variables:
+/// @note - pipeline_queues, pipeline_occupancies (from pipeline.h): The pipeline
+double pipeline_fill(int q)
+{
+    const pipeline_occupancy& o = pipeline_occupancies[q];
+    if (o.samples == 0) return 0.0;
+    return (double)o.total / o.samples / pipeline_queues[q]->capacity();
+}
+
+/// @name pipeline_bottleneck
+/// @brief Guesses which stage limits the pipeline: the one whose input queue backs up the most while its output
+/// @brief queue runs the driest. Only real queues count, so a stage scores the average of how full its input was and
+/// @brief how empty its output was, and the generator (no input) and aggregator (no output) score on one queue each.
+/// @return The stage
+/// @note This function uses the following global variables:
+/// @note - pipeline_stage_count, pipeline_queues, pipeline_occupancies (from pipeline.h): The pipeline
+int pipeline_bottleneck()
+{
+    int best = 0;
+    double best_score = -1.0;
+    for (int s = 0; s < pipeline_stage_count; ++s)
+    {
+        double score = 0.0;
+        int queues = 0;
+        if (s > 0)                                          // ? A full input queue: this stage can't keep up
+        {
+            score += pipeline_fill(s - 1);
+            ++queues;
+        }
+        if (s + 1 < pipeline_stage_count)                   // ? An empty output queue: the stage after is starved
+        {
+            score += 1.0 - pipeline_fill(s);
+            ++queues;
+        }
+        score /= queues;
+        if (score > best_score)
+        {
+            best_score = score;
+            best = s;
+        }
+    }
+    return best;
+}
+
+/// @brief The bookkeeping for every span a pipeline thread writes downstream: counts it, and whether it filled the queue
+struct pipeline_push_hook
+{
+    int capacity;   // ? The downstream queue's capacity
+
+    void operator()(size_t, int n, int occupancy) const
+    {
+        stat_add(my_stats->produced, n);
+        if (occupancy == capacity) stat_add(my_stats->full, 1);
+    }
+};
+
+/// @brief The bookkeeping for every span a pipeline thread reads from upstream: counts it, and whether it emptied the queue
+struct pipeline_pop_hook
+{
+    void operator()(size_t, int n, int occupancy) const
+    {
+        stat_add(my_stats->consumed, n);
+        if (occupancy == 0) stat_add(my_stats->empty, 1);
+    }
+};
+
+/// @name pipeline_worker
+/// @brief Runs one thread of a stage, flat out, a batch at a time. Generators stop when the run does; every other
+/// @brief stage keeps going until its input queue is closed and empty. The last thread out of a stage closes the
+/// @brief queue downstream, so a stop works its way down the pipeline and every generated item gets through.
+/// @param param The thread's pipeline_args, passed as a void*
+/// @return NULL
+/// @note This function uses the following global variables:
+/// @note - pipeline_stages, pipeline_stage_count, pipeline_queues (from pipeline.h): The pipeline
+/// @note - execute, batch_size, item_range, run_seed (from project3.cpp): The run's settings
+/// @note - my_stats (from stats.h): This thread's counters
+void *pipeline_worker(void *param)
+{
+    pipeline_args* args = (pipeline_args*)param;
+    pipeline_stage& stage = pipeline_stages[args->stage];
+    stats_register(args->slot);
+    rng_seed(run_seed, args->slot);
+
+    bounded_queue<buffer_item>* in = (args->stage > 0) ? pipeline_queues[args->stage - 1] : NULL;
+    bounded_queue<buffer_item>* out = (args->stage + 1 < pipeline_stage_count) ? pipeline_queues[args->stage] : NULL;
+    std::vector<buffer_item> items(batch_size);
+    std::vector<uint8_t> flags(batch_size);
+    pipeline_push_hook push_hook = { out != NULL ? out->capacity() : 0 };
+
+    for (;;)
+    {
+        int n;
+        if (in == NULL)                                     // ? A generator makes a whole batch at once
+        {
+            if (!execute) break;
+            rng_fill(items.data(), batch_size, item_range);
+            n = batch_size;
+        }
+        else
+        {
+            n = in->pop_n(items.data(), batch_size, pipeline_pop_hook());
+            if (n == 0) break;                              // ? Upstream is finished and everything it sent is through
+        }
+
+        if (stage.kind == STAGE_FILTER)                     // ? Keeps only the primes, in order
+        {
+            prime_count(items.data(), n, flags.data());
+            int kept = 0;
+            for (int i = 0; i < n; ++i)
+            {
+                items[kept] = items[i];
+                kept += flags[i];
+            }
+            n = kept;
+        }
+        else if (stage.kind == STAGE_AGGREGATE)
+        {
+            stat_add(my_stats->primes, prime_count(items.data(), n));
+        }
+
+        if (out != NULL && n > 0 && out->push_n(items.data(), n, push_hook) != n) break;
+    }
+
+    if (stage.running.fetch_sub(1, std::memory_order_acq_rel) == 1 && out != NULL)
+    {
+        out->close();
+    }
+    return NULL;
+}
+
+#endif // _PIPELINE_H_DEFINED_
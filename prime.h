@@ -0,0 +1,178 @@
+// **********************************************************
+// *
+// * Sam Young
+// * Operating Systems
+// * Programming Project 3: Process Synchronization
+// * March 14, 2025
+// * Dr. Siming Liu
+// *
+// **********************************************************
+
+#ifndef _PRIME_H_DEFINED_
+#define _PRIME_H_DEFINED_
+
+#define PRIME_SEGMENT_BITS  (32768 * 8)     // ? Odd numbers sieved per segment (a 32 KiB slice of the bitset, about L1-sized)
+#define PRIME_SIEVE_MAX     (1u << 28)      // ? The largest sieve we build (16 MiB); values above it use Miller-Rabin
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+uint64_t*   prime_bits = NULL;          // ? Bit i is set if 2i + 1 is prime, for every odd number below prime_limit
+uint32_t    prime_limit = 0;            // ? The sieve covers 0 .. prime_limit - 1
+
+/// @name prime_initialize
+/// @brief Builds the sieve for every number below a limit, one cache-sized segment at a time, so lookups in that
+/// @brief range are a single bit test. Call it once, before any thread starts classifying.
+/// @param limit The first number the sieve doesn't need to cover (capped at PRIME_SIEVE_MAX)
+/// @note This function uses the following global variables:
+/// @note - prime_bits, prime_limit (from prime.h): The sieve
+void prime_initialize(uint32_t limit)
+{
+    if (limit > PRIME_SIEVE_MAX) limit = PRIME_SIEVE_MAX;
+    if (limit < 3) limit = 3;
+
+    size_t odd_count = limit / 2;                           // ? The odd numbers 1, 3, ..., below limit
+    size_t words = (odd_count + 63) / 64;
+    delete[] prime_bits;
+    prime_bits = new uint64_t[words];
+    memset(prime_bits, 0xff, words * sizeof(uint64_t));
+    prime_bits[0] &= ~1ull;                                 // ? 1 isn't prime
+
+    // ? The odd primes up to sqrt(limit) do all the crossing out, so they get a plain sieve of their own
+    uint32_t root = 1;
+    while ((uint64_t)(root + 1) * (root + 1) < limit) ++root;
+    std::vector<bool> small_composite(root + 1, false);
+    std::vector<uint32_t> small_primes;
+    for (uint32_t p = 3; p <= root; p += 2)
+    {
+        if (small_composite[p]) continue;
+        small_primes.push_back(p);
+        for (uint32_t m = p * p; m <= root; m += 2 * p) small_composite[m] = true;
+    }
+
+    // ? Then each segment crosses out the odd multiples of those primes while it's still in cache
+    for (size_t low = 0; low < odd_count; low += PRIME_SEGMENT_BITS)
+    {
+        size_t high = low + PRIME_SEGMENT_BITS;
+        if (high > odd_count) high = odd_count;
+
+        for (uint32_t p : small_primes)
+        {
+            uint64_t first = (uint64_t)p * p;               // ? Smaller multiples were crossed out by smaller primes
+            uint64_t seg_start = 2 * low + 1;
+            if (first < seg_start)
+            {
+                first = (seg_start + p - 1) / p * p;
+                if ((first & 1) == 0) first += p;           // ? Only odd multiples are in the bitset
+            }
+            for (uint64_t i = first / 2; i < high; i += p)
+            {
+                prime_bits[i / 64] &= ~(1ull << (i % 64));
+            }
+        }
+    }
+    prime_limit = limit;
+}
+
+/// @name prime_mulmod
+/// @brief Multiplies two numbers modulo a third without overflowing
+inline uint64_t prime_mulmod(uint64_t a, uint64_t b, uint64_t m)
+{
+    return (uint64_t)((unsigned __int128)a * b % m);
+}
+
+/// @name prime_powmod
+/// @brief Raises a number to a power modulo a third
+inline uint64_t prime_powmod(uint64_t base, uint64_t exp, uint64_t m)
+{
+    uint64_t result = 1;
+    base %= m;
+    while (exp > 0)
+    {
+        if (exp & 1) result = prime_mulmod(result, base, m);
+        base = prime_mulmod(base, base, m);
+        exp >>= 1;
+    }
+    return result;
+}
+
+/// @name prime_miller_rabin
+/// @brief Deterministic Miller-Rabin for any 64-bit number: these seven bases have no strong pseudoprime in common
+/// @brief below 2^64, so the answer is exact.
+/// @param n The number (odd, above 2)
+/// @return true if n is prime, false otherwise
+bool prime_miller_rabin(uint64_t n)
+{
+    static const uint64_t bases[] = { 2, 325, 9375, 28178, 450775, 9780504, 1795265022 };
+
+    uint64_t d = n - 1;
+    int s = 0;
+    while ((d & 1) == 0) { d >>= 1; ++s; }
+
+    for (uint64_t a : bases)
+    {
+        a %= n;
+        if (a == 0) continue;                               // ? The base is a multiple of n, so it proves nothing
+
+        uint64_t x = prime_powmod(a, d, n);
+        if (x == 1 || x == n - 1) continue;
+
+        bool witness = true;
+        for (int r = 1; r < s && witness; ++r)
+        {
+            x = prime_mulmod(x, x, n);
+            if (x == n - 1) witness = false;
+        }
+        if (witness) return false;                          // ? a proves n is composite
+    }
+    return true;
+}
+
+/// @name prime_is
+/// @brief Detects whether a number is prime: a bit test inside the sieve, Miller-Rabin above it
+/// @param n The number
+/// @return true if the number is prime, false otherwise
+/// @note This function uses the following global variables:
+/// @note - prime_bits, prime_limit (from prime.h): The sieve
+inline bool prime_is(int64_t n)
+{
+    if (n < 2) return false;
+    if ((n & 1) == 0) return n == 2;
+    if ((uint64_t)n < prime_limit) return (prime_bits[n / 128] >> ((n / 2) % 64)) & 1;
+    if (n % 3 == 0 || n % 5 == 0 || n % 7 == 0) return n <= 7;
+    return prime_miller_rabin((uint64_t)n);
+}
+
+/// @name prime_count
+/// @brief Classifies a whole batch of numbers at once and counts the primes. Numbers inside the sieve take a
+/// @brief branch-free bit test, so a batch costs one pass of loads and adds; anything above it falls back to prime_is.
+/// @param items The numbers
+/// @param n How many numbers there are
+/// @param flags Where to store 1 for each prime and 0 otherwise (NULL to only count)
+/// @return How many of the numbers are prime
+/// @note This function uses the following global variables:
+/// @note - prime_bits, prime_limit (from prime.h): The sieve
+int prime_count(const int64_t* items, int n, uint8_t* flags = NULL)
+{
+    int found = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        uint64_t v = (uint64_t)items[i];                    // ? Negative numbers become huge here and take the slow path
+        int is;
+        if (v < prime_limit)
+        {
+            uint32_t bit = (uint32_t)(prime_bits[v / 128] >> ((v / 2) % 64)) & 1;
+            is = (int)((bit & v) | (v == 2));               // ? Odd numbers use their bit; 2 is the only even prime
+        }
+        else
+        {
+            is = prime_is(items[i]);
+        }
+        if (flags != NULL) flags[i] = (uint8_t)is;
+        found += is;
+    }
+    return found;
+}
+
+#endif // _PRIME_H_DEFINED_
@@ -0,0 +1,821 @@
+// **********************************************************
+// *
+// * Sam Young
+// * Operating Systems
+// * Programming Project 3: Process Synchronization
+// * March 14, 2025
+// * Dr. Siming Liu
+// *
+// **********************************************************
+
+#ifndef _QUEUE_H_DEFINED_
+#define _QUEUE_H_DEFINED_
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
+#include <semaphore.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <linux/futex.h>
+#include <climits>
+#include <ctime>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/// @brief The synchronization strategy a queue runs with
+enum buffer_engine
+{
+    ENGINE_MUTEX,   // ? The original semaphore + mutex implementation (the baseline)
+    ENGINE_SPSC,    // ? A lock-free single-producer/single-consumer ring
+    ENGINE_MPMC     // ? A lock-free bounded multi-producer/multi-consumer ring with per-slot sequence numbers
+};
+
+#define QUEUE_SPIN_LIMIT        256         // ? How many times the adaptive policy spins with cpu_relax before yielding
+#define QUEUE_YIELD_LIMIT       16          // ? How many times the adaptive policy yields before parking
+
+/// @brief How a thread waits when the queue it wants is full or empty
+enum wait_policy
+{
+    WAIT_ADAPTIVE,  // ? Spins a little, then yields, then parks until woken (the default for the lock-free engines)
+    WAIT_SPIN,      // ? Busy-polls and never gives up the CPU (for latency-critical, pinned threads)
+    WAIT_PARK       // ? Parks right away (the default for the mutex engine: the original sem_trywait then sem_wait)
+};
+
+/// @name queue_default_wait
+/// @brief Gets the wait policy an engine runs with unless told otherwise. The mutex engine keeps its original
+/// @brief semaphore waits, so it behaves the same as before wait policies existed.
+/// @param engine The engine
+/// @return Its default policy
+inline wait_policy queue_default_wait(buffer_engine engine)
+{
+    return (engine == ENGINE_MUTEX) ? WAIT_PARK : WAIT_ADAPTIVE;
+}
+
+/// @brief A futex word padded out to its own cache line, with a count of the threads parked on it. Wakers skip the
+/// @brief wake-up system call entirely unless someone is actually parked.
+struct alignas(CACHE_LINE_SIZE) padded_futex
+{
+    std::atomic<int>    epoch;      // ? Bumped by every wake-up, so a thread that's about to park notices it
+    std::atomic<int>    waiters;    // ? How many threads are parked (or about to park) on this word
+};
+
+/// @brief An atomic ring index padded out to its own cache line so the producer and consumer sides don't false-share
+struct alignas(CACHE_LINE_SIZE) padded_index
+{
+    std::atomic<size_t> value;
+};
+
+/// @name cpu_relax
+/// @brief Tells the CPU we're in a spin-wait loop (a `pause` on x86) so a spinning thread doesn't starve its sibling
+inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#else
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+/// @name queue_futex_wait
+/// @brief Sleeps until a futex word is woken or no longer holds an expected value (or a timeout passes)
+/// @param word The futex word
+/// @param expected The value the word had when the caller decided to sleep
+/// @param timeout The most time to sleep. Defaults to NULL, which sleeps until woken.
+inline void queue_futex_wait(std::atomic<int>* word, int expected, const timespec* timeout = NULL)
+{
+    syscall(SYS_futex, (int*)word, FUTEX_WAIT_PRIVATE, expected, timeout, NULL, 0);
+}
+
+/// @name queue_futex_wake
+/// @brief Wakes up to n threads sleeping on a futex word
+/// @param word The futex word
+/// @param n The most threads to wake
+inline void queue_futex_wake(std::atomic<int>* word, int n)
+{
+    syscall(SYS_futex, (int*)word, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+/// @brief The hook used when a caller doesn't pass one: does nothing
+struct queue_no_hook
+{
+    void operator()(size_t, int, int) const {}
+};
+
+/// @brief A bounded FIFO queue of T with a capacity chosen at runtime, run by one of the buffer engines.
+/// @brief Items are constructed directly in the queue's slots and moved straight into the caller's storage when
+/// @brief removed, so move-only and large types work without extra copies. Any number of queues can exist at once.
+/// @brief
+/// @brief Every insert/remove may take a hook, called as hook(first_position, count, occupancy) after the items
+/// @brief are in (or out of) their slots but before other threads can see the change: inside the mutex for the
+/// @brief mutex engine, before publishing for the lock-free ones. Use at(position + i) inside it to look at them.
+template <typename T>
+class bounded_queue
+{
+public:
+    void (*on_wait)(bool full, int capacity) = NULL;    // ? Called once per operation that finds the queue full (true) or empty (false)
+
+    /// @brief Creates an empty queue
+    /// @param engine The engine to run with
+    /// @param capacity The number of slots (power-of-two capacities index with a mask instead of a division)
+    /// @param policy How threads wait while the queue is full or empty
+    /// @note The slots and sequence numbers get pages of their own, mapped fresh and touched here, so the kernel's
+    /// @note first-touch policy puts them on the NUMA node of whichever CPU the constructing thread runs on
+    bounded_queue(buffer_engine engine, int capacity, wait_policy policy = WAIT_ADAPTIVE)
+        : engine_(engine), policy_(policy), capacity_(capacity), mask_((size_t)capacity - 1),
+          pow2_((capacity & (capacity - 1)) == 0)
+    {
+        static_assert(alignof(T) <= 4096, "slots are page-aligned, which must satisfy T's alignment");
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t sequence_offset = round_up(sizeof(T) * capacity, CACHE_LINE_SIZE);
+        region_size_ = round_up(sequence_offset + sizeof(std::atomic<size_t>) * capacity, page);
+        void* region = mmap(NULL, region_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (region == MAP_FAILED) throw std::bad_alloc();
+        memset(region, 0, region_size_);                        // ? Touches every page now, from this thread's CPU
+
+        slots_ = static_cast<T*>(region);
+        sequence_ = reinterpret_cast<std::atomic<size_t>*>(static_cast<char*>(region) + sequence_offset);
+        for (int i = 0; i < capacity; ++i)
+        {
+            new (&sequence_[i]) std::atomic<size_t>(i);         // ? Slot i is ready to be written at position i
+        }
+
+        pthread_mutex_init(&mutex_, NULL);
+        sem_init(&empty_, 0, capacity);
+        sem_init(&full_, 0, 0);
+        count_.store(0, std::memory_order_relaxed);
+        head_ = 0;
+        tail_ = 0;
+        write_index_.value.store(0, std::memory_order_relaxed);
+        read_index_.value.store(0, std::memory_order_relaxed);
+        cached_read_.value.store(0, std::memory_order_relaxed);
+        cached_write_.value.store(0, std::memory_order_relaxed);
+        not_full_.epoch.store(0, std::memory_order_relaxed);
+        not_full_.waiters.store(0, std::memory_order_relaxed);
+        not_empty_.epoch.store(0, std::memory_order_relaxed);
+        not_empty_.waiters.store(0, std::memory_order_relaxed);
+        closed_.store(false, std::memory_order_relaxed);
+    }
+
+    /// @brief Destroys whatever items are still in the queue and frees its storage
+    ~bounded_queue()
+    {
+        if (!std::is_trivially_destructible<T>::value)
+        {
+            size_t first = (engine_ == ENGINE_MUTEX) ? (size_t)head_ : read_index_.value.load(std::memory_order_relaxed);
+            for (int i = 0; i < size(); ++i)
+            {
+                at(first + i).~T();
+            }
+        }
+        pthread_mutex_destroy(&mutex_);
+        sem_destroy(&empty_);
+        sem_destroy(&full_);
+        munmap((void*)slots_, region_size_);                    // ? The sequence numbers share the mapping
+    }
+
+    bounded_queue(const bounded_queue&) = delete;
+    bounded_queue& operator=(const bounded_queue&) = delete;
+
+    /// @brief Constructs an item in place in the next free slot, blocking while the queue is full
+    /// @param args The item's constructor arguments
+    /// @return true on success, false if the queue was closed
+    template <typename... Args>
+    bool emplace(Args&&... args)
+    {
+        size_t pos;
+        if (claim_write(1, &pos) == 0) return false;       // ? The queue was closed (nothing is claimed or locked)
+        new (&at(pos)) T(std::forward<Args>(args)...);
+        queue_no_hook hook;
+        commit_write(pos, 1, hook);
+        return true;
+    }
+
+    /// @brief Copies an item into the queue, blocking while the queue is full
+    template <typename Hook = queue_no_hook>
+    bool push(const T& item, Hook hook = Hook())
+    {
+        return push_n(&item, 1, hook) == 1;
+    }
+
+    /// @brief Moves an item into the queue, blocking while the queue is full
+    template <typename Hook = queue_no_hook>
+    bool push(T&& item, Hook hook = Hook())
+    {
+        return push_n(&item, 1, hook) == 1;
+    }
+
+    /// @brief Moves the oldest item into the caller's storage, blocking while the queue is empty
+    template <typename Hook = queue_no_hook>
+    bool pop(T& out, Hook hook = Hook())
+    {
+        return pop_n(&out, 1, hook) == 1;
+    }
+
+    /// @brief Inserts a span of items, blocking until all of them are in (or the queue is closed). Each round claims as many contiguous
+    /// @brief slots as are free in one step and fills them (with at most two memcpy calls for trivially copyable
+    /// @brief types). Items are moved from a non-const span and copied from a const one.
+    /// @param items The items
+    /// @param n How many items
+    /// @param hook Called once per round (see the class comment)
+    /// @return The number of items inserted (fewer than n only if the queue was closed)
+    template <typename Src, typename Hook = queue_no_hook>
+    int push_n(Src* items, int n, Hook hook = Hook())
+    {
+        int done = 0;
+        while (done < n)
+        {
+            size_t pos;
+            int k = claim_write(n - done, &pos);
+            if (k == 0) break;                              // ? The queue was closed
+            copy_in(pos, items + done, k);
+            commit_write(pos, k, hook);
+            done += k;
+        }
+        return done;
+    }
+
+    /// @brief Removes up to max_n items into the caller's storage, blocking until at least one is available
+    /// @param out Where to move the items
+    /// @param max_n The most items to remove
+    /// @param hook Called once with the removed span (see the class comment)
+    /// @return The number of items removed (0 only once the queue is closed and empty)
+    template <typename Hook = queue_no_hook>
+    int pop_n(T* out, int max_n, Hook hook = Hook())
+    {
+        size_t pos;
+        int k = claim_read(max_n, &pos);
+        if (k == 0) return 0;                               // ? The queue is closed and empty
+        hook_read(pos, k, hook);
+        copy_out(pos, out, k);
+        commit_read(pos, k);
+        return k;
+    }
+
+    /// @brief Removes up to max_n items into the caller's storage if any are there, without ever waiting
+    /// @param out Where to move the items
+    /// @param max_n The most items to remove
+    /// @param hook Called once with the removed span (see the class comment)
+    /// @return The number of items removed (0 if the queue was empty)
+    template <typename Hook = queue_no_hook>
+    int try_pop_n(T* out, int max_n, Hook hook = Hook())
+    {
+        size_t pos;
+        int k = claim_read(max_n, &pos, false);
+        if (k == 0) return 0;
+        hook_read(pos, k, hook);
+        copy_out(pos, out, k);
+        commit_read(pos, k);
+        return k;
+    }
+
+    /// @brief Closes the queue: every later insert fails, and every thread blocked on the queue wakes up. Removes
+    /// @brief keep returning whatever items are left and only fail once the queue is empty, so consumers can drain it.
+    void close()
+    {
+        if (engine_ == ENGINE_MUTEX)
+        {
+            pthread_mutex_lock(&mutex_);                    // ? Anyone who locks after this sees the queue closed
+            closed_.store(true, std::memory_order_seq_cst);
+            pthread_mutex_unlock(&mutex_);
+
+            sem_post(&empty_);                              // ? Wakes one blocked thread on each side. Each thread that
+            sem_post(&full_);                               // ? wakes to a closed queue posts again to wake the next.
+        }
+        else
+        {
+            closed_.store(true, std::memory_order_seq_cst);
+            wake(not_full_, INT_MAX, true);
+            wake(not_empty_, INT_MAX, true);
+        }
+    }
+
+    /// @brief Gets whether the queue has been closed
+    bool closed() const { return closed_.load(std::memory_order_acquire); }
+
+    /// @brief Gets the number of items in the queue (a snapshot; it may change right away)
+    int size() const
+    {
+        if (engine_ == ENGINE_MUTEX) return count_.load(std::memory_order_relaxed);   // ? No lock: readers only want a snapshot
+
+        size_t r = read_index_.value.load(std::memory_order_acquire);
+        size_t w = write_index_.value.load(std::memory_order_acquire);
+        if (w < r) return 0;                                    // ? A consumer claimed a slot between our two loads
+        return (w - r > (size_t)capacity_) ? capacity_ : (int)(w - r);
+    }
+
+    /// @brief Gets the number of slots
+    int capacity() const { return capacity_; }
+
+    /// @brief Gets the engine the queue runs with
+    buffer_engine engine() const { return engine_; }
+
+    /// @brief Gets how threads wait on the queue
+    wait_policy policy() const { return policy_; }
+
+    /// @brief Gets how many threads are parked waiting for room (on the futex, or blocked in sem_wait for the mutex engine)
+    int parked_producers() const { return not_full_.waiters.load(std::memory_order_relaxed); }
+
+    /// @brief Gets how many threads are parked waiting for items (on the futex, or blocked in sem_wait for the mutex engine)
+    int parked_consumers() const { return not_empty_.waiters.load(std::memory_order_relaxed); }
+
+    /// @brief Gets the slot the next item will be read from
+    int read_slot() const
+    {
+        return (engine_ == ENGINE_MUTEX) ? head_ : (int)index(read_index_.value.load(std::memory_order_relaxed));
+    }
+
+    /// @brief Gets the slot the next item will be written to
+    int write_slot() const
+    {
+        return (engine_ == ENGINE_MUTEX) ? tail_ : (int)index(write_index_.value.load(std::memory_order_relaxed));
+    }
+
+    /// @brief Gets the item in the slot for a position. Only meaningful for positions the caller owns (i.e. inside a
+    /// @brief hook), or for trivially copyable types where reading a stale slot is harmless.
+    T& at(size_t pos) const { return slots_[index(pos)]; }
+
+    /// @brief Sets every slot to a value, so snapshots of a fresh queue show something recognizable.
+    /// @brief Only for trivially copyable types, and only while the queue is empty and unused.
+    void fill(const T& value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "fill() is only for trivially copyable types");
+        for (int i = 0; i < capacity_; ++i)
+        {
+            memcpy((void*)&slots_[i], (const void*)&value, sizeof(T));
+        }
+    }
+
+private:
+    buffer_engine           engine_;        // ? The engine selected at construction
+    wait_policy             policy_;        // ? How threads wait while the queue is full or empty
+    int                     capacity_;      // ? The number of slots
+    size_t                  mask_;          // ? capacity_ - 1, for power-of-two capacities
+    bool                    pow2_;          // ? Whether capacity_ is a power of two
+    T*                      slots_;         // ? The ring's storage (raw, items are constructed in place)
+    std::atomic<size_t>*    sequence_;      // ? The MPMC engine's per-slot sequence numbers (after the slots, in the same mapping)
+    size_t                  region_size_;   // ? The size of the mapping holding both
+
+    pthread_mutex_t         mutex_;         // ? The mutex engine's lock
+    sem_t                   empty_, full_;  // ? The mutex engine's semaphores, counting empty and full slots
+    std::atomic<int>        count_;         // ? The mutex engine's number of items (written under mutex_, readable without it)
+    int                     head_;          // ? The mutex engine's read slot
+    int                     tail_;          // ? The mutex engine's write slot
+
+    padded_index            write_index_;   // ? The lock-free engines' monotonically increasing write position
+    padded_index            read_index_;    // ? The lock-free engines' monotonically increasing read position
+    padded_index            cached_read_;   // ? The SPSC producer's private copy of read_index_
+    padded_index            cached_write_;  // ? The SPSC consumer's private copy of write_index_
+    padded_futex            not_full_;      // ? Where the lock-free engines' producers park while the queue is full
+    padded_futex            not_empty_;     // ? Where the lock-free engines' consumers park while the queue is empty
+                                            // ? (the mutex engine only uses their waiter counts, for parked_*())
+    std::atomic<bool>       closed_;        // ? Set by close(): inserts fail, removes fail once the queue is empty
+
+    /// @brief Rounds a size up to a multiple of a power of two
+    static size_t round_up(size_t n, size_t to) { return (n + to - 1) & ~(to - 1); }
+
+    /// @brief Maps a position onto a slot. Power-of-two capacities use a mask instead of a division.
+    size_t index(size_t pos) const
+    {
+        return pow2_ ? (pos & mask_) : (pos % (size_t)capacity_);
+    }
+
+    /// @brief Tells the on_wait callback (if any) that this operation has to wait
+    void notify_wait(bool is_full)
+    {
+        if (on_wait != NULL) on_wait(is_full, capacity_);
+    }
+
+    /// @brief Waits on a semaphore (the mutex engine) according to the wait policy. glibc's sem_post only makes
+    /// @brief the wake-up system call when a thread is blocked in sem_wait, so spinning first avoids it entirely.
+    void wait_sem(sem_t* sem)
+    {
+        if (policy_ == WAIT_PARK)
+        {
+            park_sem(sem);
+            return;
+        }
+        for (unsigned spins = 1; sem_trywait(sem) != 0; ++spins)
+        {
+            if (policy_ == WAIT_SPIN || spins < QUEUE_SPIN_LIMIT)
+            {
+                cpu_relax();
+            }
+            else if (spins < QUEUE_SPIN_LIMIT + QUEUE_YIELD_LIMIT)
+            {
+                sched_yield();
+            }
+            else
+            {
+                park_sem(sem);
+                return;
+            }
+        }
+    }
+
+    /// @brief Blocks in sem_wait, counted in the matching futex's waiters so parked_producers()/parked_consumers()
+    /// @brief cover the mutex engine too
+    void park_sem(sem_t* sem)
+    {
+        std::atomic<int>& waiters = (sem == &empty_) ? not_full_.waiters : not_empty_.waiters;
+        waiters.fetch_add(1, std::memory_order_relaxed);
+        sem_wait(sem);
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    /// @brief Takes one step of waiting on a lock-free engine according to the wait policy: a pause, a yield, or
+    /// @brief (once those run out) parking on a futex until a waker bumps it.
+    /// @param w The futex to park on
+    /// @param spins How many steps this operation has already taken
+    /// @param ready Checks whether the wait is over. Called again after registering as a waiter, so a wake-up
+    /// @param ready can't slip in between the check and the sleep.
+    template <typename Ready>
+    void backoff(padded_futex& w, unsigned& spins, Ready ready)
+    {
+        ++spins;
+        if (policy_ == WAIT_SPIN || (policy_ == WAIT_ADAPTIVE && spins < QUEUE_SPIN_LIMIT))
+        {
+            cpu_relax();
+            return;
+        }
+        if (policy_ == WAIT_ADAPTIVE && spins < QUEUE_SPIN_LIMIT + QUEUE_YIELD_LIMIT)
+        {
+            sched_yield();
+            return;
+        }
+
+        int epoch = w.epoch.load(std::memory_order_acquire);
+        w.waiters.fetch_add(1, std::memory_order_seq_cst);
+        if (!ready())                                       // ? Pairs with the fence in wake(): either we see the change, or the waker sees us
+        {
+            queue_futex_wait(&w.epoch, epoch);
+        }
+        w.waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    /// @brief Wakes up to n threads parked on a futex, if there are any (called after publishing a change)
+    /// @param w The futex
+    /// @param n The most threads to wake
+    /// @param always Whether to wake even under the spin policy (close() does, in case anyone slipped into a park)
+    void wake(padded_futex& w, int n, bool always = false)
+    {
+        if (policy_ == WAIT_SPIN && !always) return;        // ? Nobody ever parks
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (w.waiters.load(std::memory_order_relaxed) == 0) return;
+
+        w.epoch.fetch_add(1, std::memory_order_release);
+        queue_futex_wake(&w.epoch, n);
+    }
+
+    /// @brief Constructs n items into consecutive slots starting at pos, splitting the copy where it wraps
+    template <typename Src>
+    void copy_in(size_t pos, Src* items, int n)
+    {
+        if (std::is_trivially_copyable<T>::value && std::is_same<typename std::remove_const<Src>::type, T>::value)
+        {
+            size_t slot = index(pos);
+            int first = (int)((size_t)capacity_ - slot);        // ? How many slots are left before the end of the array
+            if (first > n) first = n;
+
+            memcpy((void*)(slots_ + slot), (const void*)items, first * sizeof(T));
+            memcpy((void*)slots_, (const void*)(items + first), (n - first) * sizeof(T));
+        }
+        else
+        {
+            for (int i = 0; i < n; ++i)
+            {
+                new (&at(pos + i)) T(std::move(items[i]));  // ? Moves from a T*, copies from a const T*
+            }
+        }
+    }
+
+    /// @brief Moves n items out of consecutive slots starting at pos into the caller's storage
+    void copy_out(size_t pos, T* out, int n)
+    {
+        if (std::is_trivially_copyable<T>::value)
+        {
+            size_t slot = index(pos);
+            int first = (int)((size_t)capacity_ - slot);
+            if (first > n) first = n;
+
+            memcpy((void*)out, (const void*)(slots_ + slot), first * sizeof(T));
+            memcpy((void*)(out + first), (const void*)slots_, (n - first) * sizeof(T));
+        }
+        else
+        {
+            for (int i = 0; i < n; ++i)
+            {
+                T& item = at(pos + i);
+                out[i] = std::move(item);
+                item.~T();
+            }
+        }
+    }
+
+    /// @brief Waits for at least one free slot and claims as many as possible (up to want). For the mutex engine
+    /// @brief this returns with the mutex held; commit_write releases it.
+    /// @param want The most slots to claim
+    /// @param pos Where to store the first claimed position
+    /// @return The number of slots claimed
+    int claim_write(int want, size_t* pos)
+    {
+        if (closed_.load(std::memory_order_acquire)) return 0;
+
+        if (engine_ == ENGINE_MUTEX)
+        {
+            if (sem_trywait(&empty_) == -1)                     // ? Waits for a sign that the buffer has an open slot
+            {
+                notify_wait(true);
+                wait_sem(&empty_);
+            }
+            int k = 1;
+            while (k < want && sem_trywait(&empty_) == 0) ++k;  // ? Claims every other open slot we can get without blocking
+
+            pthread_mutex_lock(&mutex_);
+            if (closed_.load(std::memory_order_relaxed))        // ? Closed while we waited: hand the slots (and the wake-up) on
+            {
+                pthread_mutex_unlock(&mutex_);
+                for (int i = 0; i < k; ++i) sem_post(&empty_);
+                return 0;
+            }
+            *pos = tail_;
+            return k;
+        }
+
+        if (engine_ == ENGINE_SPSC)
+        {
+            size_t p = write_index_.value.load(std::memory_order_relaxed);
+            size_t cached = cached_read_.value.load(std::memory_order_relaxed);
+
+            if (p - cached >= (size_t)capacity_)                // ? Looks full from our cached copy, so refresh it
+            {
+                cached = read_index_.value.load(std::memory_order_acquire);
+                if (p - cached >= (size_t)capacity_)            // ? Really full, so we wait
+                {
+                    notify_wait(true);
+                    unsigned spins = 0;
+                    auto ready = [&] {
+                        cached = read_index_.value.load(std::memory_order_acquire);
+                        return p - cached < (size_t)capacity_ || closed_.load(std::memory_order_acquire);
+                    };
+                    do
+                    {
+                        backoff(not_full_, spins, ready);
+                    } while (!ready());
+                    if (p - cached >= (size_t)capacity_) return 0; // ? Still full, so we were woken by close()
+                }
+                cached_read_.value.store(cached, std::memory_order_relaxed);
+            }
+
+            int k = (int)((size_t)capacity_ - (p - cached));    // ? Every free slot we know about
+            *pos = p;
+            return (k < want) ? k : want;
+        }
+
+        unsigned spins = 0;                                     // ? MPMC: count the ready slots, then claim them with one CAS
+        bool waited = false;
+        for (;;)
+        {
+            size_t p = write_index_.value.load(std::memory_order_relaxed);
+            int k = 0;
+            while (k < want && k < capacity_
+                   && sequence_[index(p + k)].load(std::memory_order_acquire) == p + k)
+            {
+                ++k;
+            }
+
+            if (k == 0)
+            {
+                intptr_t diff = (intptr_t)sequence_[index(p)].load(std::memory_order_acquire) - (intptr_t)p;
+                if (diff < 0)                                   // ? The queue is full (otherwise we just lost a race)
+                {
+                    if (closed_.load(std::memory_order_acquire)) return 0;
+                    if (!waited)
+                    {
+                        notify_wait(true);
+                        waited = true;
+                    }
+                    backoff(not_full_, spins, [&] {
+                        return (intptr_t)sequence_[index(p)].load(std::memory_order_acquire) - (intptr_t)p >= 0
+                               || closed_.load(std::memory_order_acquire);
+                    });
+                }
+                continue;
+            }
+            if (write_index_.value.compare_exchange_weak(p, p + k, std::memory_order_relaxed))
+            {
+                *pos = p;
+                return k;
+            }
+        }
+    }
+
+    /// @brief Calls the hook and publishes k filled slots starting at pos
+    template <typename Hook>
+    void commit_write(size_t pos, int k, Hook& hook)
+    {
+        if (engine_ == ENGINE_MUTEX)
+        {
+            tail_ = (int)index(tail_ + k);                      // ? Uses a curcular incrementation to increment the write index
+            int count = count_.load(std::memory_order_relaxed) + k;
+            count_.store(count, std::memory_order_relaxed);
+            hook(pos, k, count);
+
+            pthread_mutex_unlock(&mutex_);
+            for (int i = 0; i < k; ++i) sem_post(&full_);       // ? Posts one full slot per item we published
+        }
+        else if (engine_ == ENGINE_SPSC)
+        {
+            size_t r = read_index_.value.load(std::memory_order_relaxed);
+            hook(pos, k, (int)(pos + k - r));
+            write_index_.value.store(pos + k, std::memory_order_release);   // ? Publishes the whole span at once
+            wake(not_empty_, 1);                                // ? There's only the one consumer
+        }
+        else
+        {
+            hook(pos, k, size());
+            for (int i = 0; i < k; ++i)
+            {
+                sequence_[index(pos + i)].store(pos + i + 1, std::memory_order_release);
+            }
+            wake(not_empty_, k);                                // ? One consumer per item we published
+        }
+    }
+
+    /// @brief Waits for at least one full slot and claims as many as possible (up to want). For the mutex engine
+    /// @brief this returns with the mutex held; commit_read releases it.
+    /// @param want The most slots to claim
+    /// @param pos Where to store the first claimed position
+    /// @param block Whether to wait while the queue is empty, or give up right away
+    /// @return The number of slots claimed
+    int claim_read(int want, size_t* pos, bool block = true)
+    {
+        if (engine_ == ENGINE_MUTEX)
+        {
+            if (closed_.load(std::memory_order_acquire))        // ? Closed and already empty: don't wait at all
+            {
+                pthread_mutex_lock(&mutex_);
+                bool drained = (count_.load(std::memory_order_relaxed) == 0);
+                pthread_mutex_unlock(&mutex_);
+                if (drained) return 0;
+            }
+            if (sem_trywait(&full_))                            // ? Waits for a sign that the buffer has a full slot
+            {
+                if (!block) return 0;
+                notify_wait(false);
+                wait_sem(&full_);
+            }
+            int k = 1;
+            while (k < want && sem_trywait(&full_) == 0) ++k;
+
+            pthread_mutex_lock(&mutex_);
+            int count = count_.load(std::memory_order_relaxed);
+            if (k > count)                                      // ? Only after close(): some of what we took were wake-ups,
+            {                                                   // ? not items, so we pass those on to the next waiter
+                for (int i = count; i < k; ++i) sem_post(&full_);
+                k = count;
+                if (k == 0)
+                {
+                    pthread_mutex_unlock(&mutex_);
+                    return 0;
+                }
+            }
+            *pos = head_;
+            return k;
+        }
+
+        if (engine_ == ENGINE_SPSC)
+        {
+            size_t p = read_index_.value.load(std::memory_order_relaxed);
+            size_t cached = cached_write_.value.load(std::memory_order_relaxed);
+
+            if (p == cached)                                    // ? Looks empty from our cached copy, so refresh it
+            {
+                cached = write_index_.value.load(std::memory_order_acquire);
+                if (p == cached)                                // ? Really empty, so we wait
+                {
+                    if (!block) return 0;
+                    notify_wait(false);
+                    unsigned spins = 0;
+                    auto ready = [&] {
+                        bool closing = closed_.load(std::memory_order_acquire);     // ? Read first, so an item published
+                        cached = write_index_.value.load(std::memory_order_acquire);  // ? before close() is still seen
+                        return p != cached || closing;
+                    };
+                    do
+                    {
+                        backoff(not_empty_, spins, ready);
+                    } while (!ready());
+                    if (p == cached) return 0;                  // ? Still empty, so we were woken by close()
+                }
+                cached_write_.value.store(cached, std::memory_order_relaxed);
+            }
+
+            int k = (int)(cached - p);                          // ? Every full slot we know about
+            *pos = p;
+            return (k < want) ? k : want;
+        }
+
+        unsigned spins = 0;
+        bool waited = false;
+        for (;;)
+        {
+            size_t p = read_index_.value.load(std::memory_order_relaxed);
+            int k = 0;
+            while (k < want && k < capacity_
+                   && sequence_[index(p + k)].load(std::memory_order_acquire) == p + k + 1)
+            {
+                ++k;
+            }
+
+            if (k == 0)
+            {
+                intptr_t diff = (intptr_t)sequence_[index(p)].load(std::memory_order_acquire) - (intptr_t)(p + 1);
+                if (diff < 0)                                   // ? The queue is empty (otherwise we just lost a race)
+                {
+                    if (!block) return 0;
+                    if (closed_.load(std::memory_order_acquire)
+                        && (intptr_t)sequence_[index(p)].load(std::memory_order_acquire) - (intptr_t)(p + 1) < 0)
+                    {
+                        return 0;                               // ? Closed, and still empty after seeing it closed
+                    }
+                    if (!waited)
+                    {
+                        notify_wait(false);
+                        waited = true;
+                    }
+                    backoff(not_empty_, spins, [&] {
+                        return (intptr_t)sequence_[index(p)].load(std::memory_order_acquire) - (intptr_t)(p + 1) >= 0
+                               || closed_.load(std::memory_order_acquire);
+                    });
+                }
+                continue;
+            }
+            if (read_index_.value.compare_exchange_weak(p, p + k, std::memory_order_relaxed))
+            {
+                *pos = p;
+                return k;
+            }
+        }
+    }
+
+    /// @brief Updates the mutex engine's bookkeeping and calls the hook for k slots being read from pos
+    template <typename Hook>
+    void hook_read(size_t pos, int k, Hook& hook)
+    {
+        if (engine_ == ENGINE_MUTEX)
+        {
+            head_ = (int)index(head_ + k);                      // ? Uses a curcular incrementation to increment the read index
+            int count = count_.load(std::memory_order_relaxed) - k;
+            count_.store(count, std::memory_order_relaxed);
+            hook(pos, k, count);
+        }
+        else if (engine_ == ENGINE_SPSC)
+        {
+            size_t w = cached_write_.value.load(std::memory_order_relaxed);
+            hook(pos, k, (int)(w - pos - k));
+        }
+        else
+        {
+            hook(pos, k, size());
+        }
+    }
+
+    /// @brief Hands k emptied slots starting at pos back to the producers
+    void commit_read(size_t pos, int k)
+    {
+        if (engine_ == ENGINE_MUTEX)
+        {
+            pthread_mutex_unlock(&mutex_);
+            for (int i = 0; i < k; ++i) sem_post(&empty_);      // ? Posts one empty slot per item we took
+        }
+        else if (engine_ == ENGINE_SPSC)
+        {
+            read_index_.value.store(pos + k, std::memory_order_release);    // ? Hands every slot back at once
+            wake(not_full_, 1);
+        }
+        else
+        {
+            for (int i = 0; i < k; ++i)
+            {
+                sequence_[index(pos + i)].store(pos + i + capacity_, std::memory_order_release);  // ? Frees the slot for the next lap
+            }
+            wake(not_full_, k);
+        }
+    }
+};
+
+#endif // _QUEUE_H_DEFINED_
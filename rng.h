@@ -0,0 +1,144 @@
+// **********************************************************
+// *
+// * Sam Young
+// * Operating Systems
+// * Programming Project 3: Process Synchronization
+// * March 14, 2025
+// * Dr. Siming Liu
+// *
+// **********************************************************
+
+#ifndef _RNG_H_DEFINED_
+#define _RNG_H_DEFINED_
+
+#define RNG_LANES 4     // ? Independent generators rng_fill steps side by side, so the compiler can vectorize them
+
+#include <cstdint>
+
+/// @brief One thread's random number generators: a xoshiro256** stream for single values, and RNG_LANES xoshiro256+
+/// @brief streams laid out lane by lane for filling whole batches. Each thread owns its state, so drawing a number
+/// @brief takes no lock and no allocation (unlike rand(), which serializes every thread on glibc's lock).
+struct rng_state
+{
+    uint64_t s[4];              // ? The single-value stream
+    uint64_t s0[RNG_LANES];     // ? The batch streams' state words, one array per word
+    uint64_t s1[RNG_LANES];
+    uint64_t s2[RNG_LANES];
+    uint64_t s3[RNG_LANES];
+};
+
+thread_local rng_state my_rng;  // ? The calling thread's generators
+
+/// @name rng_splitmix
+/// @brief Steps a splitmix64 generator, which turns one 64-bit seed into any number of well-mixed state words
+/// @param x The generator's state
+/// @return The next word
+inline uint64_t rng_splitmix(uint64_t& x)
+{
+    uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+/// @name rng_rotl
+/// @brief Rotates a 64-bit word left
+inline uint64_t rng_rotl(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+/// @name rng_seed
+/// @brief Seeds the calling thread's generators. The same run seed and stream always give the same numbers, and
+/// @brief different streams (e.g. thread slots) give unrelated ones.
+/// @param seed The run's seed
+/// @param stream Which of the run's streams this thread takes
+/// @note This function uses the following global variables:
+/// @note - my_rng (from rng.h): The calling thread's generators
+void rng_seed(uint64_t seed, int stream)
+{
+    uint64_t x = seed ^ ((uint64_t)(stream + 1) * 0xd1342543de82ef95ull);
+    for (int i = 0; i < 4; ++i) my_rng.s[i] = rng_splitmix(x);
+    for (int l = 0; l < RNG_LANES; ++l)
+    {
+        my_rng.s0[l] = rng_splitmix(x);
+        my_rng.s1[l] = rng_splitmix(x);
+        my_rng.s2[l] = rng_splitmix(x);
+        my_rng.s3[l] = rng_splitmix(x);
+    }
+}
+
+/// @name rng_next
+/// @brief Draws the next 64 random bits (xoshiro256**)
+/// @return The bits
+/// @note This function uses the following global variables:
+/// @note - my_rng (from rng.h): The calling thread's generators
+inline uint64_t rng_next()
+{
+    uint64_t* s = my_rng.s;
+    uint64_t result = rng_rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rng_rotl(s[3], 45);
+    return result;
+}
+
+/// @name rng_below
+/// @brief Draws a number from 0 to range - 1 with a multiply and a shift instead of a division
+/// @param range How many values there are (at least 1)
+/// @return The number
+inline uint32_t rng_below(uint32_t range)
+{
+    return (uint32_t)(((rng_next() >> 32) * range) >> 32);
+}
+
+/// @name rng_fill
+/// @brief Fills a whole batch with numbers from 0 to range - 1 in one call. The RNG_LANES streams are stepped
+/// @brief together with plain array arithmetic, which the compiler turns into vector instructions.
+/// @param out Where to store the numbers
+/// @param n How many numbers to draw
+/// @param range How many values there are (at least 1)
+/// @note This function uses the following global variables:
+/// @note - my_rng (from rng.h): The calling thread's generators
+void rng_fill(int64_t* out, int n, uint32_t range)
+{
+    uint64_t s0[RNG_LANES], s1[RNG_LANES], s2[RNG_LANES], s3[RNG_LANES];
+    for (int l = 0; l < RNG_LANES; ++l)                     // ? Works on local copies so nothing aliases the output
+    {
+        s0[l] = my_rng.s0[l]; s1[l] = my_rng.s1[l]; s2[l] = my_rng.s2[l]; s3[l] = my_rng.s3[l];
+    }
+
+    int i = 0;
+    for (; i + RNG_LANES <= n; i += RNG_LANES)
+    {
+        uint64_t bits[RNG_LANES];
+        for (int l = 0; l < RNG_LANES; ++l)                 // ? xoshiro256+ in every lane at once
+        {
+            bits[l] = s0[l] + s3[l];
+            uint64_t t = s1[l] << 17;
+            s2[l] ^= s0[l];
+            s3[l] ^= s1[l];
+            s1[l] ^= s2[l];
+            s0[l] ^= s3[l];
+            s2[l] ^= t;
+            s3[l] = (s3[l] << 45) | (s3[l] >> 19);
+        }
+        for (int l = 0; l < RNG_LANES; ++l)
+        {
+            out[i + l] = (int64_t)(((bits[l] >> 32) * range) >> 32);
+        }
+    }
+    for (; i < n; ++i) out[i] = rng_below(range);          // ? The few left over come from the single-value stream
+
+    for (int l = 0; l < RNG_LANES; ++l)
+    {
+        my_rng.s0[l] = s0[l]; my_rng.s1[l] = s1[l]; my_rng.s2[l] = s2[l]; my_rng.s3[l] = s3[l];
+    }
+}
+
+#endif // _RNG_H_DEFINED_
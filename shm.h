@@ -0,0 +1,644 @@
+// **********************************************************
+// *
+// * Sam Young
+// * Operating Systems
+// * Programming Project 3: Process Synchronization
+// * March 14, 2025
+// * Dr. Siming Liu
+// *
+// **********************************************************
+
+#ifndef _SHM_H_DEFINED_
+#define _SHM_H_DEFINED_
+
+#define SHM_MAGIC           0x31514350u     // ? "PCQ1": the first word of every segment this program creates
+#define SHM_VERSION         2               // ? Bumped whenever the layout after the first four words changes
+#define SHM_INIT_TIMEOUT_MS 2000            // ? How long to wait for another process to finish creating a segment
+#define SHM_MAX_PRODUCERS   64              // ? How many producer processes can be attached at once
+#define SHM_REAP_INTERVAL_MS 100            // ? How often waiting consumers check whether the producer processes are still alive
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <climits>
+#include <string>
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include "queue.h"
+
+/// @brief Where a segment is in its setup. A freshly truncated segment reads as all zeroes, i.e. SHM_STATE_EMPTY.
+enum shm_state : uint32_t
+{
+    SHM_STATE_EMPTY = 0,        // ? Created, but nothing written yet
+    SHM_STATE_INITIALIZING,     // ? The creator is filling in the layout
+    SHM_STATE_READY             // ? Safe to attach to
+};
+
+/// @brief The start of every segment. magic, version, state and creator stay at these offsets in every version, so
+/// @brief any build can tell whether a segment is one it understands; everything after them belongs to SHM_VERSION.
+struct shm_header
+{
+    uint32_t                magic;              // ? SHM_MAGIC once the segment is ready
+    uint32_t                version;            // ? SHM_VERSION of the process that created it
+    std::atomic<uint32_t>   state;              // ? A shm_state
+    std::atomic<int32_t>    creator;            // ? The pid of the process that created it
+    uint32_t                header_size;        // ? sizeof(shm_header), rounded up to a cache line
+    uint32_t                slot_size;          // ? sizeof one item
+    uint32_t                capacity;           // ? The number of slots
+    uint32_t                reserved;
+    uint64_t                sequence_offset;    // ? Where the per-slot sequence numbers start
+    uint64_t                slot_offset;        // ? Where the slots start
+    uint64_t                region_size;        // ? The whole segment's size
+
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> write_index;    // ? The next position to write
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> read_index;     // ? The next position to read
+    padded_futex            not_full;           // ? Where producers (in any process) park while the ring is full
+    padded_futex            not_empty;          // ? Where consumers (in any process) park while the ring is empty
+    alignas(CACHE_LINE_SIZE) std::atomic<int> producers;   // ? Producer processes attached right now
+    std::atomic<int>        attached;           // ? Processes attached right now, of any role
+    std::atomic<int>        closed;             // ? Set when the last producer process detaches; consumers drain, then stop
+    std::atomic<int32_t>    producer_pids[SHM_MAX_PRODUCERS];  // ? Each attached producer process's pid (0 for a free entry),
+                                                // ? so one that dies without detaching can be noticed and counted out
+};
+
+/// @name shm_futex_wait
+/// @brief Sleeps until a futex word in shared memory is woken or no longer holds an expected value. Unlike
+/// @brief queue_futex_wait this uses the shared futex operations, so wake-ups cross process boundaries.
+/// @param word The futex word
+/// @param expected The value the word had when the caller decided to sleep
+/// @param timeout The longest to sleep, or NULL to sleep until woken
+inline void shm_futex_wait(std::atomic<int>* word, int expected, const timespec* timeout = NULL)
+{
+    syscall(SYS_futex, (int*)word, FUTEX_WAIT, expected, timeout, NULL, 0);
+}
+
+/// @name shm_futex_wake
+/// @brief Wakes up to n threads, in any process, sleeping on a futex word in shared memory
+/// @param word The futex word
+/// @param n The most threads to wake
+inline void shm_futex_wake(std::atomic<int>* word, int n)
+{
+    syscall(SYS_futex, (int*)word, FUTEX_WAKE, n, NULL, NULL, 0);
+}
+
+/// @brief A bounded multi-producer/multi-consumer ring of T in a POSIX shared memory segment, so threads in separate
+/// @brief processes can hand items to each other directly. The algorithm is the MPMC engine's (per-slot sequence
+/// @brief numbers, batches claimed with one CAS), with the indices, sequence numbers and futex words all living in
+/// @brief the segment. Hooks work as in bounded_queue.
+/// @brief
+/// @brief Segments are created with O_EXCL, so exactly one process lays one out, and attachers wait for it to be
+/// @brief marked ready. A segment whose creator died before finishing is detected (its pid is gone) and replaced.
+/// @brief Producer processes register their pids in the header, and waiting consumers check every
+/// @brief SHM_REAP_INTERVAL_MS that they're still alive, so a producer killed without detaching still counts out and
+/// @brief the ring still closes. A process that dies in the middle of an insert or remove can still leave its claimed
+/// @brief slots stuck; remove the segment (shm_ring::remove) to start over.
+template <typename T>
+class shm_ring
+{
+    static_assert(std::is_trivially_copyable<T>::value, "shm_ring items are copied between processes byte for byte");
+
+public:
+    void (*on_wait)(bool full, int capacity) = NULL;    // ? Called once per operation that finds the ring full (true) or empty (false)
+
+    /// @brief Opens a segment, creating and laying it out if it doesn't exist yet
+    /// @param name The segment's name (e.g. "/osproj4")
+    /// @param capacity The number of slots, if this process creates it (an existing segment keeps its own)
+    /// @param policy How this process's threads wait while the ring is full or empty
+    /// @param producing Whether this process inserts items (the ring closes once every producer process detaches)
+    /// @param error Where to describe what went wrong, on failure
+    /// @return The ring, or NULL on failure
+    static shm_ring* attach(const char* name, int capacity, wait_policy policy, bool producing, std::string* error)
+    {
+        for (int attempt = 0; attempt < 3; ++attempt)
+        {
+            bool created = true;
+            int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+            if (fd < 0 && errno == EEXIST)
+            {
+                created = false;
+                fd = shm_open(name, O_RDWR, 0);
+                if (fd < 0 && errno == ENOENT) continue;            // ? Removed between our two opens, so try again
+            }
+            if (fd < 0)
+            {
+                *error = std::string("shm_open: ") + strerror(errno);
+                return NULL;
+            }
+
+            shm_header* header = created ? create(fd, capacity, error) : wait_ready(fd, error);
+            if (header == NULL)
+            {
+                bool stale = error->empty();                        // ? An empty error means "abandoned, replace it"
+                struct stat seen;
+                bool have = fstat(fd, &seen) == 0;
+                ::close(fd);
+                if (created) shm_unlink(name);                      // ? Don't leave a half-made segment behind
+                if (!stale) return NULL;
+
+                int again = shm_open(name, O_RDWR, 0);               // ? Only removes the very segment we judged stale,
+                struct stat now;                                    // ? not one someone else just made in its place
+                if (again >= 0 && have && fstat(again, &now) == 0 && now.st_ino == seen.st_ino) shm_unlink(name);
+                if (again >= 0) ::close(again);
+                continue;
+            }
+            ::close(fd);                                            // ? The mapping keeps the segment alive
+
+            shm_ring* ring = new shm_ring(header, policy, created);
+            header->attached.fetch_add(1, std::memory_order_relaxed);
+            if (producing && !ring->register_producer())
+            {
+                delete ring;
+                *error = "every producer entry is taken (at most " + std::to_string(SHM_MAX_PRODUCERS) + " producer processes)";
+                return NULL;
+            }
+            return ring;
+        }
+        *error = "the segment kept being replaced while attaching";
+        return NULL;
+    }
+
+    /// @brief Removes a segment's name, e.g. to recover from a crash. Processes already attached keep their mapping.
+    /// @param name The segment's name
+    /// @return true on success, false otherwise (errno says why)
+    static bool remove(const char* name)
+    {
+        return shm_unlink(name) == 0;
+    }
+
+    /// @brief Detaches from the segment (closing this process's side first if it hasn't been)
+    ~shm_ring()
+    {
+        close();
+        header_->attached.fetch_sub(1, std::memory_order_relaxed);
+        munmap((void*)header_, (size_t)header_->region_size);
+    }
+
+    shm_ring(const shm_ring&) = delete;
+    shm_ring& operator=(const shm_ring&) = delete;
+
+    /// @brief Copies a span of items into the ring, blocking until all of them are in (or this process closes its side)
+    /// @param items The items
+    /// @param n How many items
+    /// @param hook Called once per round, before the items are published
+    /// @return The number of items inserted (fewer than n only after close())
+    template <typename Hook = queue_no_hook>
+    int push_n(const T* items, int n, Hook hook = Hook())
+    {
+        int done = 0;
+        while (done < n)
+        {
+            size_t pos;
+            int k = claim_write(n - done, &pos);
+            if (k == 0) break;
+            for (int i = 0; i < k; ++i) at(pos + i) = items[done + i];
+            hook(pos, k, size());
+            for (int i = 0; i < k; ++i)
+            {
+                sequence_[index(pos + i)].store(pos + i + 1, std::memory_order_release);
+            }
+            wake(header_->not_empty, k);
+            done += k;
+        }
+        return done;
+    }
+
+    /// @brief Removes up to max_n items into the caller's storage, blocking until at least one is available
+    /// @param out Where to copy the items
+    /// @param max_n The most items to remove
+    /// @param hook Called once with the removed span, before the slots are handed back
+    /// @return The number of items removed (0 once the ring is finished and empty, or after stop())
+    template <typename Hook = queue_no_hook>
+    int pop_n(T* out, int max_n, Hook hook = Hook())
+    {
+        size_t pos;
+        int k = claim_read(max_n, &pos);
+        if (k == 0) return 0;
+        hook(pos, k, size());
+        for (int i = 0; i < k; ++i)
+        {
+            out[i] = at(pos + i);
+            sequence_[index(pos + i)].store(pos + i + capacity_, std::memory_order_release);
+        }
+        wake(header_->not_full, k);
+        return k;
+    }
+
+    /// @brief Closes this process's side: its inserts fail from now on, and if it was the last producer process, the
+    /// @brief ring is closed for everyone, so consumers in every process drain what's left and then stop. This
+    /// @brief process's consumers also stop once the ring is empty while no producer process is attached, even if
+    /// @brief none ever was.
+    void close()
+    {
+        local_closed_.store(true, std::memory_order_seq_cst);
+        wake(header_->not_full, INT_MAX, true);                 // ? Our blocked producers are parked with everyone else's
+
+        if (producing_)
+        {
+            producing_ = false;
+            release_producer(producer_entry_, getpid());
+        }
+        if (header_->producers.load(std::memory_order_seq_cst) == 0)
+        {
+            wake(header_->not_empty, INT_MAX, true);            // ? Our parked consumers can stop now if the ring is empty
+        }
+    }
+
+    /// @brief Makes this process's removes give up right away instead of draining
+    void stop()
+    {
+        local_stopped_.store(true, std::memory_order_seq_cst);
+        wake(header_->not_empty, INT_MAX, true);
+    }
+
+    /// @brief Gets whether the ring has been closed for everyone (every producer process has detached)
+    bool closed() const { return header_->closed.load(std::memory_order_acquire) != 0; }
+
+    /// @brief Gets whether this process's consumers stop once the ring is empty: it has been closed for everyone, or
+    /// @brief this process closed its side while no producer process is attached
+    bool finished() const
+    {
+        return closed() || (local_closed_.load(std::memory_order_acquire)
+                            && header_->producers.load(std::memory_order_acquire) == 0);
+    }
+
+    /// @brief Gets the number of items in the ring (a snapshot; it may change right away)
+    int size() const
+    {
+        uint64_t r = header_->read_index.load(std::memory_order_acquire);
+        uint64_t w = header_->write_index.load(std::memory_order_acquire);
+        if (w < r) return 0;
+        return (w - r > (uint64_t)capacity_) ? capacity_ : (int)(w - r);
+    }
+
+    /// @brief Gets the number of slots
+    int capacity() const { return capacity_; }
+
+    /// @brief Gets whether this process created the segment (as opposed to attaching to an existing one)
+    bool created() const { return created_; }
+
+    /// @brief Gets the pid of the process that created the segment
+    pid_t creator() const { return header_->creator.load(std::memory_order_relaxed); }
+
+    /// @brief Gets how many processes are attached right now
+    int attached() const { return header_->attached.load(std::memory_order_relaxed); }
+
+    /// @brief Gets how many threads, in any process, are parked waiting for room
+    int parked_producers() const { return header_->not_full.waiters.load(std::memory_order_relaxed); }
+
+    /// @brief Gets how many threads, in any process, are parked waiting for items
+    int parked_consumers() const { return header_->not_empty.waiters.load(std::memory_order_relaxed); }
+
+    /// @brief Gets the slot the next item will be read from
+    int read_slot() const { return (int)index(header_->read_index.load(std::memory_order_relaxed)); }
+
+    /// @brief Gets the slot the next item will be written to
+    int write_slot() const { return (int)index(header_->write_index.load(std::memory_order_relaxed)); }
+
+    /// @brief Gets the item in the slot for a position (see bounded_queue::at)
+    T& at(size_t pos) const { return slots_[index(pos)]; }
+
+private:
+    shm_header*             header_;        // ? The mapped segment
+    std::atomic<uint64_t>*  sequence_;      // ? The per-slot sequence numbers, in the segment
+    T*                      slots_;         // ? The slots, in the segment
+    int                     capacity_;      // ? The number of slots (copied out of the header)
+    size_t                  mask_;          // ? capacity_ - 1, for power-of-two capacities
+    bool                    pow2_;          // ? Whether capacity_ is a power of two
+    wait_policy             policy_;        // ? How this process's threads wait
+    bool                    created_;       // ? Whether this process created the segment
+    bool                    producing_ = false;                 // ? Whether this process still counts as a producer
+    int                     producer_entry_ = -1;               // ? Its entry in the header's producer_pids
+    std::atomic<uint64_t>   next_reap_{0};                      // ? When a waiting consumer next checks on the producers
+    std::atomic<bool>       local_closed_{false};               // ? Set by close(): this process's inserts fail
+    std::atomic<bool>       local_stopped_{false};              // ? Set by stop(): this process's removes fail
+
+    shm_ring(shm_header* header, wait_policy policy, bool created)
+        : header_(header), capacity_((int)header->capacity), mask_((size_t)capacity_ - 1),
+          pow2_((capacity_ & (capacity_ - 1)) == 0), policy_(policy), created_(created)
+    {
+        sequence_ = (std::atomic<uint64_t>*)((char*)header + header->sequence_offset);
+        slots_ = (T*)((char*)header + header->slot_offset);
+    }
+
+    /// @brief Rounds a size up to a multiple of a power of two
+    static uint64_t round_up(uint64_t n, uint64_t to) { return (n + to - 1) & ~(to - 1); }
+
+    /// @brief Sizes, maps and lays out a segment this process just created with O_EXCL
+    static shm_header* create(int fd, int capacity, std::string* error)
+    {
+        uint64_t header_size = round_up(sizeof(shm_header), CACHE_LINE_SIZE);
+        uint64_t slot_offset = round_up(header_size + (uint64_t)capacity * sizeof(std::atomic<uint64_t>), CACHE_LINE_SIZE);
+        uint64_t region_size = round_up(slot_offset + (uint64_t)capacity * sizeof(T), (uint64_t)sysconf(_SC_PAGESIZE));
+
+        if (ftruncate(fd, (off_t)region_size) != 0)
+        {
+            *error = std::string("ftruncate: ") + strerror(errno);
+            return NULL;
+        }
+        void* base = mmap(NULL, region_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED)
+        {
+            *error = std::string("mmap: ") + strerror(errno);
+            return NULL;
+        }
+
+        shm_header* header = new (base) shm_header();           // ? Still invisible to attachers: state reads EMPTY
+        header->creator.store(getpid(), std::memory_order_relaxed);
+        header->state.store(SHM_STATE_INITIALIZING, std::memory_order_release);
+        header->header_size = (uint32_t)header_size;
+        header->slot_size = (uint32_t)sizeof(T);
+        header->capacity = (uint32_t)capacity;
+        header->sequence_offset = header_size;
+        header->slot_offset = slot_offset;
+        header->region_size = region_size;
+        header->write_index.store(0, std::memory_order_relaxed);
+        header->read_index.store(0, std::memory_order_relaxed);
+        header->not_full.epoch.store(0, std::memory_order_relaxed);
+        header->not_full.waiters.store(0, std::memory_order_relaxed);
+        header->not_empty.epoch.store(0, std::memory_order_relaxed);
+        header->not_empty.waiters.store(0, std::memory_order_relaxed);
+        header->producers.store(0, std::memory_order_relaxed);
+        header->attached.store(0, std::memory_order_relaxed);
+        header->closed.store(0, std::memory_order_relaxed);
+        for (int i = 0; i < SHM_MAX_PRODUCERS; ++i) header->producer_pids[i].store(0, std::memory_order_relaxed);
+
+        std::atomic<uint64_t>* sequence = (std::atomic<uint64_t>*)((char*)base + header_size);
+        for (int i = 0; i < capacity; ++i)
+        {
+            new (&sequence[i]) std::atomic<uint64_t>(i);        // ? Slot i is ready to be written at position i
+        }
+
+        header->magic = SHM_MAGIC;
+        header->version = SHM_VERSION;
+        header->state.store(SHM_STATE_READY, std::memory_order_release);   // ? Publishes everything above
+        return header;
+    }
+
+    /// @brief Maps a segment someone else created, once it's ready. Leaves error empty when the segment was
+    /// @brief abandoned mid-creation (so the caller replaces it), and describes the problem otherwise.
+    static shm_header* wait_ready(int fd, std::string* error)
+    {
+        error->clear();
+        timespec poll = { 0, 1000000 };
+        struct stat st;
+        for (int waited = 0; ; ++waited)
+        {
+            if (fstat(fd, &st) != 0)
+            {
+                *error = std::string("fstat: ") + strerror(errno);
+                return NULL;
+            }
+            if ((uint64_t)st.st_size >= sizeof(shm_header)) break;
+            if (waited >= SHM_INIT_TIMEOUT_MS) return NULL;         // ? Never even sized: the creator is gone
+            nanosleep(&poll, NULL);
+        }
+
+        void* base = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED)
+        {
+            *error = std::string("mmap: ") + strerror(errno);
+            return NULL;
+        }
+        shm_header* header = (shm_header*)base;
+
+        for (int waited = 0; header->state.load(std::memory_order_acquire) != SHM_STATE_READY; ++waited)
+        {
+            pid_t creator = header->creator.load(std::memory_order_relaxed);
+            bool gone = creator > 0 && kill(creator, 0) != 0 && errno == ESRCH;
+            if (gone || waited >= SHM_INIT_TIMEOUT_MS)
+            {
+                munmap(base, (size_t)st.st_size);
+                if (!gone && creator > 0) *error = "the segment's creator is still setting it up";
+                return NULL;
+            }
+            nanosleep(&poll, NULL);
+        }
+
+        char text[160];
+        text[0] = '\0';
+        if (header->magic != SHM_MAGIC)
+        {
+            snprintf(text, sizeof(text), "the segment isn't a queue (magic %#x)", header->magic);
+        }
+        else if (header->version != SHM_VERSION)
+        {
+            snprintf(text, sizeof(text), "the segment has layout version %u, this build understands %u", header->version, SHM_VERSION);
+        }
+        else if (header->slot_size != sizeof(T) || header->region_size != (uint64_t)st.st_size
+                 || header->slot_offset + (uint64_t)header->capacity * sizeof(T) > header->region_size)
+        {
+            snprintf(text, sizeof(text), "the segment's layout doesn't match its header");
+        }
+        if (text[0] != '\0')
+        {
+            *error = text;
+            munmap(base, (size_t)st.st_size);
+            return NULL;
+        }
+        return header;
+    }
+
+    /// @brief Maps a position onto a slot. Power-of-two capacities use a mask instead of a division.
+    size_t index(size_t pos) const
+    {
+        return pow2_ ? (pos & mask_) : (pos % (size_t)capacity_);
+    }
+
+    /// @brief Counts this process in as a producer: takes a free entry for its pid (counting out dead producers to
+    /// @brief make room if there's none) and reopens a finished ring
+    /// @return true on success, false if every entry belongs to a live producer
+    bool register_producer()
+    {
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            for (int i = 0; i < SHM_MAX_PRODUCERS; ++i)
+            {
+                int32_t expected = 0;
+                if (!header_->producer_pids[i].compare_exchange_strong(expected, (int32_t)getpid(), std::memory_order_seq_cst)) continue;
+
+                producer_entry_ = i;
+                producing_ = true;
+                header_->producers.fetch_add(1, std::memory_order_seq_cst);
+                header_->closed.store(0, std::memory_order_release);   // ? A new producer reopens a finished ring
+                return true;
+            }
+            reap_producers();
+        }
+        return false;
+    }
+
+    /// @brief Counts a producer process out, if its entry still holds its pid. The last one out closes the ring for
+    /// @brief everyone. Safe to race: only the call that clears the entry counts it out.
+    /// @param entry The producer's entry in producer_pids
+    /// @param pid The pid the entry should hold
+    void release_producer(int entry, int32_t pid)
+    {
+        if (!header_->producer_pids[entry].compare_exchange_strong(pid, 0, std::memory_order_seq_cst)) return;
+
+        if (header_->producers.fetch_sub(1, std::memory_order_seq_cst) == 1)
+        {
+            header_->closed.store(1, std::memory_order_seq_cst);
+            wake(header_->not_empty, INT_MAX, true);
+        }
+    }
+
+    /// @brief Counts out every producer process that no longer exists (e.g. it was killed without detaching)
+    void reap_producers()
+    {
+        for (int i = 0; i < SHM_MAX_PRODUCERS; ++i)
+        {
+            int32_t pid = header_->producer_pids[i].load(std::memory_order_acquire);
+            if (pid > 0 && kill(pid, 0) != 0 && errno == ESRCH) release_producer(i, pid);
+        }
+    }
+
+    /// @brief Calls reap_producers if no thread in this process has in the last SHM_REAP_INTERVAL_MS (called while
+    /// @brief consumers wait on an empty ring)
+    void reap_if_due()
+    {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        uint64_t now = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+        uint64_t due = next_reap_.load(std::memory_order_relaxed);
+        if (now < due) return;
+        if (!next_reap_.compare_exchange_strong(due, now + SHM_REAP_INTERVAL_MS * 1000000ull, std::memory_order_relaxed)) return;
+        reap_producers();
+    }
+
+    /// @brief Tells the on_wait callback (if any) that this operation has to wait
+    void notify_wait(bool is_full)
+    {
+        if (on_wait != NULL) on_wait(is_full, capacity_);
+    }
+
+    /// @brief Takes one step of waiting according to the wait policy (see bounded_queue::backoff), parking on the
+    /// @brief segment's shared futex once spinning and yielding run out (for at most timeout, if one is given)
+    template <typename Ready>
+    void backoff(padded_futex& w, unsigned& spins, Ready ready, const timespec* timeout = NULL)
+    {
+        ++spins;
+        if (policy_ == WAIT_SPIN || (policy_ == WAIT_ADAPTIVE && spins < QUEUE_SPIN_LIMIT))
+        {
+            cpu_relax();
+            return;
+        }
+        if (policy_ == WAIT_ADAPTIVE && spins < QUEUE_SPIN_LIMIT + QUEUE_YIELD_LIMIT)
+        {
+            sched_yield();
+            return;
+        }
+
+        int epoch = w.epoch.load(std::memory_order_acquire);
+        w.waiters.fetch_add(1, std::memory_order_seq_cst);
+        if (!ready()) shm_futex_wait(&w.epoch, epoch, timeout);
+        w.waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    /// @brief Wakes up to n threads parked on a futex, in any process, if there are any. Processes may run different
+    /// @brief wait policies, so unlike bounded_queue::wake this always checks for parked threads.
+    void wake(padded_futex& w, int n, bool always = false)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!always && w.waiters.load(std::memory_order_relaxed) == 0) return;
+
+        w.epoch.fetch_add(1, std::memory_order_release);
+        shm_futex_wake(&w.epoch, n);
+    }
+
+    /// @brief Waits for at least one free slot and claims as many as possible (up to want) with one CAS
+    int claim_write(int want, size_t* pos)
+    {
+        unsigned spins = 0;
+        bool waited = false;
+        for (;;)
+        {
+            if (local_closed_.load(std::memory_order_acquire)) return 0;
+
+            uint64_t p = header_->write_index.load(std::memory_order_relaxed);
+            int k = 0;
+            while (k < want && k < capacity_ && sequence_[index(p + k)].load(std::memory_order_acquire) == p + k)
+            {
+                ++k;
+            }
+
+            if (k == 0)
+            {
+                if ((int64_t)(sequence_[index(p)].load(std::memory_order_acquire) - p) < 0)   // ? Full (not just a lost race)
+                {
+                    if (!waited)
+                    {
+                        notify_wait(true);
+                        waited = true;
+                    }
+                    backoff(header_->not_full, spins, [&] {
+                        return (int64_t)(sequence_[index(p)].load(std::memory_order_acquire) - p) >= 0
+                               || local_closed_.load(std::memory_order_acquire);
+                    });
+                }
+                continue;
+            }
+            if (header_->write_index.compare_exchange_weak(p, p + k, std::memory_order_relaxed))
+            {
+                *pos = (size_t)p;
+                return k;
+            }
+        }
+    }
+
+    /// @brief Waits for at least one full slot and claims as many as possible (up to want) with one CAS
+    int claim_read(int want, size_t* pos)
+    {
+        unsigned spins = 0;
+        bool waited = false;
+        for (;;)
+        {
+            if (local_stopped_.load(std::memory_order_acquire)) return 0;
+
+            uint64_t p = header_->read_index.load(std::memory_order_relaxed);
+            int k = 0;
+            while (k < want && k < capacity_ && sequence_[index(p + k)].load(std::memory_order_acquire) == p + k + 1)
+            {
+                ++k;
+            }
+
+            if (k == 0)
+            {
+                auto empty = [&] {
+                    return (int64_t)(sequence_[index(p)].load(std::memory_order_acquire) - (p + 1)) < 0;
+                };
+                if (empty())
+                {
+                    if (finished() && empty()) return 0;        // ? Finished, and still empty after seeing it
+                    if (!waited)
+                    {
+                        notify_wait(false);
+                        waited = true;
+                    }
+                    reap_if_due();                              // ? Closes the ring if the last producer died without detaching
+                    static const timespec reap = { 0, SHM_REAP_INTERVAL_MS * 1000000L };
+                    backoff(header_->not_empty, spins, [&] {
+                        return !empty() || finished() || local_stopped_.load(std::memory_order_acquire);
+                    }, &reap);
+                }
+                continue;
+            }
+            if (header_->read_index.compare_exchange_weak(p, p + k, std::memory_order_relaxed))
+            {
+                *pos = (size_t)p;
+                return k;
+            }
+        }
+    }
+};
+
+#endif // _SHM_H_DEFINED_
@@ -0,0 +1,165 @@
+// **********************************************************
+// *
+// * Sam Young
+// * Operating Systems
+// * Programming Project 3: Process Synchronization
+// * March 14, 2025
+// * Dr. Siming Liu
+// *
+// **********************************************************
+
+#ifndef _STATS_H_DEFINED_
+#define _STATS_H_DEFINED_
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
+#include <unistd.h>
+#include <atomic>
+#include "histogram.h"
+
+/// @brief What a registered thread does
+enum thread_role
+{
+    ROLE_PRODUCER,
+    ROLE_CONSUMER
+};
+
+/// @brief One thread's counters. Each slot gets its own cache line(s) and is only ever written by its owner, so
+/// @brief counting needs no lock, no atomic read-modify-write and no allocation. Other threads may read the
+/// @brief counters at any time (relaxed), e.g. endLog once the threads are joined.
+struct alignas(CACHE_LINE_SIZE) thread_stats
+{
+    std::atomic<long>   produced;   // ? Items this thread inserted
+    std::atomic<long>   consumed;   // ? Items this thread removed
+    std::atomic<long>   full;       // ? Times this thread left the buffer full
+    std::atomic<long>   empty;      // ? Times this thread left the buffer empty
+    std::atomic<long>   primes;     // ? Prime items this consumer removed
+    std::atomic<long>   steals;     // ? Times this consumer took items from a shard other than its own (sharded mode)
+    thread_role         role;       // ? Whether this is a producer or a consumer
+    int                 index;      // ? The thread's number within its role, starting at 1
+    pid_t               tid;        // ? The thread's id, filled in when it registers
+    int                 cpu;        // ? The CPU the thread was pinned to (-1 if it wasn't)
+    latency_histogram   latency;    // ? Insert-to-remove latencies this consumer saw (benchmark mode only)
+    latency_histogram*  class_latency;  // ? The same, split by priority class (NULL unless classes are in use)
+};
+
+thread_stats*               stats_slots = NULL;     // ? One slot per producer and consumer thread
+int                         stats_slot_count = 0;   // ? How many slots there are
+int                         stats_class_count = 0;  // ? How many priority classes each slot has histograms for
+thread_stats                stats_orphan;           // ? Where threads that never registered (e.g. main) count
+thread_local thread_stats*  my_stats = &stats_orphan;   // ? The calling thread's slot
+
+/// @name stats_initialize
+/// @brief Allocates a zeroed counter slot for every producer and consumer. Producers take the first slots.
+/// @param producers The number of producer threads
+/// @param consumers The number of consumer threads
+/// @param classes How many priority classes to keep separate latency histograms for. Defaults to 0 (none).
+/// @note This function uses the following global variables:
+/// @note - stats_slots, stats_slot_count, stats_class_count (from stats.h): The slots
+/// @note - stats_orphan (from stats.h): The slot for unregistered threads
+void stats_initialize(int producers, int consumers, int classes = 0)
+{
+    for (int i = 0; i < stats_slot_count; ++i) delete[] stats_slots[i].class_latency;
+    delete[] stats_slots;
+    stats_class_count = classes;
+    stats_slot_count = producers + consumers;
+    stats_slots = new thread_stats[stats_slot_count > 0 ? stats_slot_count : 1];
+
+    for (int i = 0; i < stats_slot_count; ++i)
+    {
+        thread_stats& s = stats_slots[i];
+        s.produced.store(0, std::memory_order_relaxed);
+        s.consumed.store(0, std::memory_order_relaxed);
+        s.full.store(0, std::memory_order_relaxed);
+        s.empty.store(0, std::memory_order_relaxed);
+        s.primes.store(0, std::memory_order_relaxed);
+        s.steals.store(0, std::memory_order_relaxed);
+        s.role = (i < producers) ? ROLE_PRODUCER : ROLE_CONSUMER;
+        s.index = (i < producers) ? i + 1 : i - producers + 1;
+        s.tid = 0;
+        s.cpu = -1;
+        histogram_clear(&s.latency);
+        s.class_latency = (classes > 0) ? new latency_histogram[classes] : NULL;
+        for (int c = 0; c < classes; ++c) histogram_clear(&s.class_latency[c]);
+    }
+    stats_orphan.produced.store(0, std::memory_order_relaxed);
+    stats_orphan.consumed.store(0, std::memory_order_relaxed);
+    stats_orphan.full.store(0, std::memory_order_relaxed);
+    stats_orphan.empty.store(0, std::memory_order_relaxed);
+    stats_orphan.primes.store(0, std::memory_order_relaxed);
+    stats_orphan.steals.store(0, std::memory_order_relaxed);
+    histogram_clear(&stats_orphan.latency);
+}
+
+/// @name stats_register
+/// @brief Binds the calling thread to its slot. Call this first thing in a new thread.
+/// @param slot The slot's index (producers are 0..P-1, consumers follow)
+/// @note This function uses the following global variables:
+/// @note - stats_slots (from stats.h): The slots
+/// @note - my_stats (from stats.h): The calling thread's slot
+void stats_register(int slot)
+{
+    my_stats = &stats_slots[slot];
+    my_stats->tid = gettid();
+}
+
+/// @name stat_add
+/// @brief Adds to one of the calling thread's own counters. Only the owner writes a slot, so a relaxed load and
+/// @brief store is enough (no locked instruction).
+/// @param counter The counter to add to
+/// @param n How much to add
+inline void stat_add(std::atomic<long>& counter, long n)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+/// @name stats_total
+/// @brief Sums one counter over every slot
+/// @param field Which counter to sum (e.g. &thread_stats::produced)
+/// @return The total
+/// @note This function uses the following global variables:
+/// @note - stats_slots, stats_slot_count (from stats.h): The slots
+/// @note - stats_orphan (from stats.h): The slot for unregistered threads
+long stats_total(std::atomic<long> thread_stats::*field)
+{
+    long total = (stats_orphan.*field).load(std::memory_order_relaxed);
+    for (int i = 0; i < stats_slot_count; ++i)
+    {
+        total += (stats_slots[i].*field).load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+/// @name stats_latency
+/// @brief Merges every thread's latency histogram into one
+/// @param out Where to store the merged histogram
+/// @note This function uses the following global variables:
+/// @note - stats_slots, stats_slot_count (from stats.h): The slots
+void stats_latency(latency_histogram* out)
+{
+    histogram_clear(out);
+    for (int i = 0; i < stats_slot_count; ++i)
+    {
+        histogram_merge(out, &stats_slots[i].latency);
+    }
+}
+
+/// @name stats_class_latency
+/// @brief Merges every thread's latency histogram for one priority class into one
+/// @param cls The class
+/// @param out Where to store the merged histogram
+/// @note This function uses the following global variables:
+/// @note - stats_slots, stats_slot_count, stats_class_count (from stats.h): The slots
+void stats_class_latency(int cls, latency_histogram* out)
+{
+    histogram_clear(out);
+    if (cls >= stats_class_count) return;
+    for (int i = 0; i < stats_slot_count; ++i)
+    {
+        histogram_merge(out, &stats_slots[i].class_latency[cls]);
+    }
+}
+
+#endif // _STATS_H_DEFINED_
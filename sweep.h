@@ -0,0 +1,186 @@
+// **********************************************************
+// *
+// * Sam Young
+// * Operating Systems
+// * Programming Project 3: Process Synchronization
+// * March 14, 2025
+// * Dr. Siming Liu
+// *
+// **********************************************************
+
+#ifndef _SWEEP_H_DEFINED_
+#define _SWEEP_H_DEFINED_
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+#include "buffer.h"
+
+/// @brief One configuration in a parameter sweep
+struct sweep_point
+{
+    buffer_engine   engine;     // ? The buffer engine to run
+    wait_policy     wait;       // ? How threads wait on a full or empty buffer
+    int             producers;  // ? The number of producer threads
+    int             consumers;  // ? The number of consumer threads
+    int             capacity;   // ? The buffer's capacity
+    int             batch;      // ? Items per buffer call
+};
+
+/// @brief What one configuration measured
+struct sweep_result
+{
+    sweep_point     point;      // ? The configuration
+    double          elapsed;    // ? How long it ran, in seconds
+    long            produced;   // ? Items inserted
+    long            consumed;   // ? Items removed
+    double          throughput; // ? Items removed per second
+    double          cpu;        // ? CPU time the whole process used, in seconds
+    uint64_t        p50;        // ? Median insert-to-remove latency (ns)
+    uint64_t        p99;        // ? 99th percentile latency (ns)
+    uint64_t        p999;       // ? 99.9th percentile latency (ns)
+    uint64_t        max;        // ? Worst latency (ns)
+};
+
+/// @name engine_name
+/// @brief Gets the name the command line uses for an engine
+/// @param e The engine
+/// @return Its name
+const char* engine_name(buffer_engine e)
+{
+    switch (e)
+    {
+        case ENGINE_SPSC:   return "spsc";
+        case ENGINE_MPMC:   return "mpmc";
+        default:            return "mutex";
+    }
+}
+
+/// @name wait_policy_name
+/// @brief Gets the name the command line uses for a wait policy
+/// @param w The wait policy
+/// @return Its name
+const char* wait_policy_name(wait_policy w)
+{
+    switch (w)
+    {
+        case WAIT_SPIN:     return "spin";
+        case WAIT_PARK:     return "park";
+        default:            return "adaptive";
+    }
+}
+
+/// @name parse_int_list
+/// @brief Reads a comma-separated list of positive integers, e.g. "64,1024,65536"
+/// @param text The list
+/// @param out Where to store the numbers
+/// @return true if every entry was a positive integer, false otherwise
+bool parse_int_list(const char* text, std::vector<int>* out)
+{
+    out->clear();
+    while (*text != '\0')
+    {
+        char* end;
+        long value = strtol(text, &end, 10);
+        if (end == text || value < 1 || value > INT32_MAX) return false;
+        out->push_back((int)value);
+
+        if (*end == ',') ++end;
+        else if (*end != '\0') return false;
+        text = end;
+    }
+    return !out->empty();
+}
+
+/// @name sweep_thread_mixes
+/// @brief Lists the producer:consumer counts to try: 1:1, then N:1, 1:N and N:N for every power of two N up to
+/// @brief max_threads (and max_threads itself).
+/// @param max_threads The most producers or consumers in a mix (usually the core count)
+/// @return The mixes as {producers, consumers} pairs
+std::vector<std::pair<int, int>> sweep_thread_mixes(int max_threads)
+{
+    std::vector<int> counts;
+    for (int n = 2; n < max_threads; n *= 2) counts.push_back(n);
+    if (max_threads > 1) counts.push_back(max_threads);
+
+    std::vector<std::pair<int, int>> mixes = { { 1, 1 } };
+    for (int n : counts)
+    {
+        mixes.push_back({ n, 1 });
+        mixes.push_back({ 1, n });
+        mixes.push_back({ n, n });
+    }
+    return mixes;
+}
+
+/// @name sweep_points
+/// @brief Builds every configuration of a sweep. The spsc engine only gets the 1:1 mix.
+/// @param engines The engines to try
+/// @param waits The wait policies to try (empty for each engine's own default)
+/// @param capacities The buffer capacities to try
+/// @param batches The batch sizes to try
+/// @param max_threads The most producers or consumers in a mix
+/// @return The configurations, engine-major so each engine's scaling curve is contiguous
+std::vector<sweep_point> sweep_points(const std::vector<buffer_engine>& engines, const std::vector<wait_policy>& waits,
+                                      const std::vector<int>& capacities, const std::vector<int>& batches, int max_threads)
+{
+    std::vector<sweep_point> points;
+    for (buffer_engine e : engines)
+    {
+        for (auto& mix : sweep_thread_mixes(max_threads))
+        {
+            if (e == ENGINE_SPSC && (mix.first > 1 || mix.second > 1)) continue;
+            for (wait_policy w : waits.empty() ? std::vector<wait_policy>({ queue_default_wait(e) }) : waits)
+            {
+                for (int capacity : capacities)
+                {
+                    for (int batch : batches)
+                    {
+                        points.push_back({ e, w, mix.first, mix.second, capacity, batch });
+                    }
+                }
+            }
+        }
+    }
+    return points;
+}
+
+/// @name sweep_write_csv
+/// @brief Writes sweep results as CSV with a header row
+/// @param out Where to write
+/// @param results The results
+void sweep_write_csv(FILE* out, const std::vector<sweep_result>& results)
+{
+    fprintf(out, "engine,wait,producers,consumers,capacity,batch,elapsed_s,produced,consumed,items_per_s,cpu_s,p50_ns,p99_ns,p999_ns,max_ns\n");
+    for (const sweep_result& r : results)
+    {
+        fprintf(out, "%s,%s,%i,%i,%i,%i,%.6f,%li,%li,%.0f,%.6f,%lu,%lu,%lu,%lu\n",
+                engine_name(r.point.engine), wait_policy_name(r.point.wait), r.point.producers, r.point.consumers,
+                r.point.capacity, r.point.batch, r.elapsed, r.produced, r.consumed, r.throughput, r.cpu,
+                (unsigned long)r.p50, (unsigned long)r.p99, (unsigned long)r.p999, (unsigned long)r.max);
+    }
+}
+
+/// @name sweep_write_json
+/// @brief Writes sweep results as a JSON array of objects, one per configuration
+/// @param out Where to write
+/// @param results The results
+void sweep_write_json(FILE* out, const std::vector<sweep_result>& results)
+{
+    fprintf(out, "[\n");
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const sweep_result& r = results[i];
+        fprintf(out, "  {\"engine\": \"%s\", \"wait\": \"%s\", \"producers\": %i, \"consumers\": %i, \"capacity\": %i, "
+                     "\"batch\": %i, \"elapsed_s\": %.6f, \"produced\": %li, \"consumed\": %li, \"items_per_s\": %.0f, "
+                     "\"cpu_s\": %.6f, \"p50_ns\": %lu, \"p99_ns\": %lu, \"p999_ns\": %lu, \"max_ns\": %lu}%s\n",
+                engine_name(r.point.engine), wait_policy_name(r.point.wait), r.point.producers, r.point.consumers,
+                r.point.capacity, r.point.batch, r.elapsed, r.produced, r.consumed, r.throughput, r.cpu,
+                (unsigned long)r.p50, (unsigned long)r.p99, (unsigned long)r.p999, (unsigned long)r.max,
+                (i + 1 < results.size()) ? "," : "");
+    }
+    fprintf(out, "]\n");
+}
+
+#endif // _SWEEP_H_DEFINED_
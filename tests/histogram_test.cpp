@@ -0,0 +1,106 @@
+// **********************************************************
+// *
+// * Sam Young
+// * Operating Systems
+// * Programming Project 3: Process Synchronization
+// * March 14, 2025
+// * Dr. Siming Liu
+// *
+// **********************************************************
+
+// ? Checks the latency histogram's bucket and percentile math. Run with "make test"; exits non-zero on failure.
+
+#include <cstdio>
+#include <initializer_list>
+#include "histogram.h"
+
+int failures = 0;                       // ? How many checks failed
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAILED %s:%i: %s\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+latency_histogram one, other, both;     // ? Too big for the stack of a test function
+
+/// @name test_buckets
+/// @brief Small values get a bucket each; every value lands in a bucket whose range holds it, and no bucket is wider
+/// @brief than 1/HISTOGRAM_SUB_COUNT of the values in it
+void test_buckets()
+{
+    for (uint64_t v = 0; v < 2 * HISTOGRAM_SUB_COUNT; ++v)
+    {
+        CHECK(histogram_bucket(v) == (int)v);
+        CHECK(histogram_bucket_top((int)v) == v);
+    }
+
+    int last = 0;
+    for (uint64_t v = 1; v != 0 && v < (1ull << 62); v += v / 7 + 1)
+    {
+        int b = histogram_bucket(v);
+        CHECK(b >= last && b < HISTOGRAM_BUCKETS);          // ? Buckets only grow with the value
+        CHECK(histogram_bucket_top(b) >= v);
+        CHECK(b == 0 || histogram_bucket_top(b - 1) < v);
+        uint64_t bottom = (b == 0) ? 0 : histogram_bucket_top(b - 1) + 1;
+        CHECK((histogram_bucket_top(b) - bottom) * HISTOGRAM_SUB_COUNT <= v);
+        last = b;
+    }
+    CHECK(histogram_bucket(UINT64_MAX) < HISTOGRAM_BUCKETS);
+    CHECK(histogram_bucket_top(histogram_bucket(UINT64_MAX)) == UINT64_MAX);
+}
+
+/// @name test_percentiles
+/// @brief Percentiles report the top of the right bucket, capped at the largest value recorded
+void test_percentiles()
+{
+    histogram_clear(&one);
+    CHECK(histogram_percentile(&one, 50) == 0);             // ? Nothing recorded
+
+    for (uint64_t v = 1; v <= 1000; ++v) histogram_record(&one, v);
+    CHECK(one.total == 1000 && one.max == 1000);
+    CHECK(histogram_percentile(&one, 0) == 1);
+    CHECK(histogram_percentile(&one, 100) == 1000);
+
+    uint64_t p50 = histogram_percentile(&one, 50);
+    uint64_t p99 = histogram_percentile(&one, 99);
+    CHECK(p50 >= 500 && p50 <= 500 + 500 / HISTOGRAM_SUB_COUNT);
+    CHECK(p99 >= 990 && p99 <= 1000);
+
+    histogram_clear(&one);
+    histogram_record(&one, 123456789);
+    CHECK(histogram_percentile(&one, 50) == 123456789);     // ? One value: every percentile is that value
+}
+
+/// @name test_merge
+/// @brief Merging two histograms gives the same counts, total, maximum and percentiles as recording into one
+void test_merge()
+{
+    histogram_clear(&one);
+    histogram_clear(&other);
+    histogram_clear(&both);
+    for (uint64_t v = 0; v < 100000; v += 3)
+    {
+        histogram_record((v % 2) ? &one : &other, v * 11);
+        histogram_record(&both, v * 11);
+    }
+    histogram_merge(&one, &other);
+
+    CHECK(one.total == both.total && one.max == both.max);
+    CHECK(memcmp(one.counts, both.counts, sizeof(one.counts)) == 0);
+    for (double p : { 1.0, 50.0, 99.0, 99.9 })
+    {
+        CHECK(histogram_percentile(&one, p) == histogram_percentile(&both, p));
+    }
+}
+
+int main()
+{
+    test_buckets();
+    test_percentiles();
+    test_merge();
+
+    if (failures > 0)
+    {
+        printf("%i check(s) failed\n", failures);
+        return 1;
+    }
+    printf("histogram: all tests passed\n");
+    return 0;
+}
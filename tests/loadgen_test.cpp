@@ -0,0 +1,197 @@
+// **********************************************************
+// *
+// * Sam Young
+// * Operating Systems
+// * Programming Project 3: Process Synchronization
+// * March 14, 2025
+// * Dr. Siming Liu
+// *
+// **********************************************************
+
+// ? Checks load pattern parsing and the arrival schedules. Run with "make test"; exits non-zero on failure.
+
+#include <cstdio>
+#include <unistd.h>
+#include "loadgen.h"
+
+std::atomic<bool> execute(false);       // ? loadgen.h expects this from the main program. Left false, so a pacer only
+                                        // ? moves its schedule along instead of sleeping through it
+int failures = 0;                       // ? How many checks failed
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAILED %s:%i: %s\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+/// @name duration
+/// @brief Reads one duration, the whole text
+/// @return The duration in nanoseconds, or UINT64_MAX if it isn't one
+uint64_t duration(const char* text)
+{
+    const char* end;
+    uint64_t out;
+    if (!load_parse_duration(text, &end, &out) || *end != '\0') return UINT64_MAX;
+    return out;
+}
+
+/// @name test_parse
+/// @brief Durations take any unit, and every pattern reads its settings or explains what's wrong
+void test_parse()
+{
+    CHECK(duration("250ns") == 250);
+    CHECK(duration("100us") == 100000);
+    CHECK(duration("1.5ms") == 1500000);
+    CHECK(duration("2s") == 2000000000ull);
+    CHECK(duration("7") == 7);
+    CHECK(duration("-1ms") == UINT64_MAX);
+    CHECK(duration("ms") == UINT64_MAX);
+
+    load_spec spec;
+    std::string error;
+    CHECK(load_parse("none", &spec, &error) && spec.pattern == LOAD_NONE);
+    CHECK(load_parse("fixed:10us", &spec, &error) && spec.pattern == LOAD_FIXED && spec.gap == 10000);
+    CHECK(load_parse("poisson:1ms", &spec, &error) && spec.pattern == LOAD_POISSON && spec.gap == 1000000);
+    CHECK(load_parse("onoff:10us,5ms,20ms", &spec, &error) && spec.pattern == LOAD_ONOFF
+          && spec.gap == 10000 && spec.on == 5000000 && spec.off == 20000000);
+    CHECK(load_parse("uniform:1ms,2ms", &spec, &error) && spec.pattern == LOAD_UNIFORM
+          && spec.low == 1000000 && spec.high == 2000000);
+    CHECK(spec.source == "uniform:1ms,2ms");
+
+    for (const char* bad : { "fixed:", "fixed:1ms,2ms", "uniform:2ms,1ms", "onoff:1us,0,1ms", "onoff:1us,1ms", "bursty" })
+    {
+        error.clear();
+        CHECK(!load_parse(bad, &spec, &error) && !error.empty());
+    }
+
+    spec = load_uniform_seconds(0);
+    CHECK(spec.pattern == LOAD_NONE);
+    spec = load_uniform_seconds(3);
+    CHECK(spec.pattern == LOAD_UNIFORM && spec.low == 1000000000ull && spec.high == 3000000000ull);
+}
+
+/// @name test_trace
+/// @brief A trace file skips blanks and comments, and a bad line, an empty trace or a missing file is an error
+void test_trace()
+{
+    char path[] = "/tmp/loadgen_test_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    if (fd < 0) return;
+    FILE* out = fdopen(fd, "w");
+    fputs("# gaps\n\n100us\n  2ms\r\n", out);
+    fclose(out);
+
+    load_spec spec;
+    std::string error;
+    std::string text = std::string("trace:") + path;
+    CHECK(load_parse(text.c_str(), &spec, &error) && spec.pattern == LOAD_TRACE);
+    CHECK(spec.trace == std::vector<uint64_t>({ 100000, 2000000 }));
+
+    out = fopen(path, "w");
+    fputs("1ms\nsoon\n", out);
+    fclose(out);
+    CHECK(!load_parse(text.c_str(), &spec, &error) && error.find(":2:") != std::string::npos);
+
+    out = fopen(path, "w");
+    fputs("0\n# nothing\n", out);
+    fclose(out);
+    CHECK(!load_parse(text.c_str(), &spec, &error));
+
+    unlink(path);
+    CHECK(!load_parse(text.c_str(), &spec, &error));
+}
+
+/// @name test_schedule
+/// @brief Arrivals land on a fixed schedule from the start, on-off bursts skip the silences, and threads sharing a
+/// @brief trace replay it event for event between them
+void test_schedule()
+{
+    const uint64_t ms = 1000000;
+    load_spec spec;
+    std::string error;
+    load_pacer pacer;
+
+    CHECK(load_parse("fixed:1ms", &spec, &error));
+    load_start(&pacer, &spec);
+    uint64_t start = pacer.deadline;
+    CHECK(load_arrive(&pacer) == 0);                        // ? The run isn't going, so nobody sleeps
+    CHECK(pacer.deadline == start + 1 * ms);
+    load_arrive(&pacer);
+    CHECK(pacer.deadline == start + 2 * ms);
+
+    CHECK(load_parse("onoff:1ms,2ms,5ms", &spec, &error));
+    load_start(&pacer, &spec);
+    start = pacer.deadline;
+    uint64_t expected[] = { 1, 7, 8, 14, 15 };              // ? Bursts of 2ms at 1ms apart, 5ms of silence between
+    for (uint64_t at : expected)
+    {
+        load_arrive(&pacer);
+        CHECK(pacer.deadline == start + at * ms);
+    }
+
+    spec = load_spec();
+    spec.pattern = LOAD_TRACE;
+    spec.trace = { 1, 2, 3, 4, 5 };
+    load_pacer first, second;
+    load_start(&first, &spec, 0, 2);
+    load_start(&second, &spec, 1, 2);
+    second.deadline = first.deadline;
+    start = first.deadline;
+    std::vector<uint64_t> times;
+    for (int i = 0; i < 3; ++i)
+    {
+        load_arrive(&first);
+        times.push_back(first.deadline - start);
+        load_arrive(&second);
+        times.push_back(second.deadline - start);
+    }
+    CHECK(times == std::vector<uint64_t>({ 1, 3, 6, 10, 15, 16 }));   // ? The trace's running total, then it loops
+}
+
+/// @name test_gaps
+/// @brief Poisson gaps average out to their mean, uniform think times stay in range, and a paced thread really
+/// @brief sleeps until its deadline while the run is going
+void test_gaps()
+{
+    load_spec spec;
+    std::string error;
+    load_pacer pacer;
+    rng_seed(5, 0);
+
+    CHECK(load_parse("poisson:10us", &spec, &error));
+    load_start(&pacer, &spec);
+    double total = 0;
+    for (int i = 0; i < 100000; ++i) total += (double)load_gap(&pacer);
+    CHECK(total / 100000 > 9800 && total / 100000 < 10200);
+
+    CHECK(load_parse("uniform:1ms,2ms", &spec, &error));
+    load_start(&pacer, &spec);
+    bool in_range = true;
+    for (int i = 0; i < 10000; ++i)
+    {
+        uint64_t gap = load_gap(&pacer);
+        in_range = in_range && gap >= 1000000 && gap <= 2000000;
+    }
+    CHECK(in_range);
+    CHECK(!load_serve(&pacer, 1));                          // ? Stopped: the service time is cut short
+
+    execute = true;
+    CHECK(load_parse("fixed:2ms", &spec, &error));
+    load_start(&pacer, &spec);
+    uint64_t due = load_arrive(&pacer);
+    CHECK(due == pacer.deadline && log_now() >= due);
+    execute = false;
+}
+
+int main()
+{
+    test_parse();
+    test_trace();
+    test_schedule();
+    test_gaps();
+
+    if (failures > 0)
+    {
+        printf("%i check(s) failed\n", failures);
+        return 1;
+    }
+    printf("loadgen: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,113 @@
+// **********************************************************
+// *
+// * Sam Young
+// * Operating Systems
+// * Programming Project 3: Process Synchronization
+// * March 14, 2025
+// * Dr. Siming Liu
+// *
+// **********************************************************
+
+// ? Checks the order the log writer prints events in, and what happens when it falls behind. Run with "make test";
+// ? exits non-zero on failure.
+
+#include <cstdio>
+#include <fcntl.h>
+#include <string>
+#include <thread>
+#include "log.h"
+
+int failures = 0;                       // ? How many checks failed
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAILED %s:%i: %s\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+/// @name drain_text
+/// @brief Runs one log_drain with stdout sent to a file, and gets what it wrote
+/// @param final Passed on to log_drain
+/// @return The text
+std::string drain_text(bool final = false)
+{
+    char path[] = "/tmp/log_test_XXXXXX";
+    int fd = mkstemp(path);
+    fflush(stdout);
+    int saved = dup(1);
+    dup2(fd, 1);
+    log_drain(final);
+    fflush(stdout);
+    dup2(saved, 1);
+    close(saved);
+
+    std::string text;
+    char chunk[4096];
+    lseek(fd, 0, SEEK_SET);
+    for (ssize_t n; (n = read(fd, chunk, sizeof(chunk))) > 0; ) text.append(chunk, n);
+    close(fd);
+    unlink(path);
+    return text;
+}
+
+/// @name test_watermark
+/// @brief An event stamped before another but published after it still prints first: the later event is held back
+/// @brief until the earlier one is published
+void test_watermark()
+{
+    std::atomic<int> step(0);
+    std::thread slow([&] {
+        log_ring* ring = log_thread_ring();
+        size_t pos;
+        uint64_t now = log_claim(ring, &pos);               // ? Stamped now, published only once told to
+        log_event& e = ring->events[pos & (LOG_RING_SIZE - 1)];
+        e.timestamp = now;
+        e.tid = 1;
+        e.value = 10;
+        e.occupancy = 1;
+        e.op = LOG_WRITE;
+        step = 1;
+        while (step.load() != 2) std::this_thread::yield();
+        log_publish(ring, pos);
+        step = 3;
+    });
+    while (step.load() != 1) std::this_thread::yield();
+
+    std::thread fast([] { log_record(LOG_READ, 10, 0); });
+    fast.join();
+
+    CHECK(drain_text() == "");                              // ? The read is newer than the unpublished write
+    step = 2;
+    while (step.load() != 3) std::this_thread::yield();
+    std::string text = drain_text();
+    size_t write = text.find("writes 10"), read = text.find("reads 10");
+    CHECK(write != std::string::npos && read != std::string::npos && write < read);
+    slow.join();
+}
+
+/// @name test_full_ring
+/// @brief A thread whose ring is full drops the event instead of waiting, and the writer reports how many it lost
+void test_full_ring()
+{
+    std::thread logger([] {
+        for (int i = 0; i < LOG_RING_SIZE + 3; ++i) log_record(LOG_WRITE, i, 0);
+    });
+    logger.join();
+
+    long before = log_dropped;
+    std::string text = drain_text(true);
+    CHECK(log_dropped - before == 3);
+    CHECK(text.find("3 events were dropped") != std::string::npos);
+    CHECK(text.find("writes 4095\n") != std::string::npos && text.find("writes 4096\n") == std::string::npos);
+}
+
+int main()
+{
+    log_enabled = true;                                     // ? The test drains by hand instead of starting the writer
+    test_watermark();
+    test_full_ring();
+
+    if (failures > 0)
+    {
+        printf("%i check(s) failed\n", failures);
+        return 1;
+    }
+    printf("log: all tests passed\n");
+    return 0;
+}
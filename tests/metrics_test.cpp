@@ -0,0 +1,110 @@
+// **********************************************************
+// *
+// * Sam Young
+// * Operating Systems
+// * Programming Project 3: Process Synchronization
+// * March 14, 2025
+// * Dr. Siming Liu
+// *
+// **********************************************************
+
+// ? Checks that metric samples sent to a slow Unix socket reader stay whole lines. Run with "make test"; exits
+// ? non-zero on failure.
+
+#include <cstdio>
+#include <string>
+#include "metrics.h"
+
+bool buff_snap = false;                 // ? buffer.h expects this from the main program
+int failures = 0;                       // ? How many checks failed
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAILED %s:%i: %s\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+/// @name test_slow_reader
+/// @brief Sends lines until the socket is full without reading any, then reads everything: every line that arrives
+/// @brief is whole, and every line is either received or counted as dropped
+void test_slow_reader()
+{
+    std::string path = "/tmp/metrics_test_" + std::to_string(getpid()) + ".sock";
+    unlink(path.c_str());
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+    CHECK(bind(listener, (sockaddr*)&addr, sizeof(addr)) == 0);
+    CHECK(listen(listener, 1) == 0);
+
+    CHECK(metrics_open(("unix:" + path).c_str()));
+    int reader = accept(listener, NULL, NULL);
+    CHECK(reader >= 0);
+    int small = 4096;
+    setsockopt(metrics_fd, SOL_SOCKET, SO_SNDBUF, &small, sizeof(small));
+    setsockopt(reader, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+
+    int lines = 2000, dropped = 0;
+    for (int i = 0; i < lines; ++i)
+    {
+        char line[METRICS_LINE_SIZE];
+        int n = snprintf(line, sizeof(line), "{\"sample\":%i,\"pad\":\"%0*i\"}\n", i, 40 + i % 97, 0);
+        if (!metrics_send(line, n)) ++dropped;
+    }
+    CHECK(dropped > 0);                                     // ? Nobody read, so the socket filled up
+
+    std::string got;
+    char chunk[4096];
+    for (int tries = 0; tries < 1000; ++tries)
+    {
+        ssize_t n = recv(reader, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (n > 0) got.append(chunk, n);
+        else if (metrics_flush()) break;
+    }
+    ssize_t n;
+    while ((n = recv(reader, chunk, sizeof(chunk), MSG_DONTWAIT)) > 0) got.append(chunk, n);
+
+    int received = 0, last = -1;
+    bool whole = true, ordered = true;
+    for (size_t at = 0; at < got.size(); )
+    {
+        size_t end = got.find('\n', at);
+        if (end == std::string::npos) { whole = false; break; }
+        std::string line = got.substr(at, end - at);
+        int sample = -1;
+        whole = whole && line.front() == '{' && line.back() == '}' && sscanf(line.c_str(), "{\"sample\":%i,", &sample) == 1;
+        ordered = ordered && sample > last;
+        last = sample;
+        ++received;
+        at = end + 1;
+    }
+    CHECK(whole);
+    CHECK(ordered);
+    CHECK(received + dropped == lines);
+
+    const char* first = "{\"sample\":-1}\n";                 // ? As if the socket had only taken this line's first 5 bytes
+    CHECK(send(metrics_fd, first, 5, 0) == 5);
+    metrics_pending_len = (int)strlen(first) - 5;
+    memcpy(metrics_pending, first + 5, metrics_pending_len);
+    CHECK(metrics_send("{\"sample\":-2}\n", 14));
+    got.clear();
+    while ((n = recv(reader, chunk, sizeof(chunk), MSG_DONTWAIT)) > 0) got.append(chunk, n);
+    CHECK(got == "{\"sample\":-1}\n{\"sample\":-2}\n");       // ? The held-back end went first
+
+    close(reader);
+    close(listener);
+    close(metrics_fd);
+    metrics_fd = -1;
+    unlink(path.c_str());
+}
+
+int main()
+{
+    test_slow_reader();
+
+    if (failures > 0)
+    {
+        printf("%i check(s) failed\n", failures);
+        return 1;
+    }
+    printf("metrics: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,66 @@
+// **********************************************************
+// *
+// * Sam Young
+// * Operating Systems
+// * Programming Project 3: Process Synchronization
+// * March 14, 2025
+// * Dr. Siming Liu
+// *
+// **********************************************************
+
+// ? Checks how a pipeline run picks its bottleneck stage. Run with "make test"; exits non-zero on failure.
+
+#include <cstdio>
+#include "pipeline.h"
+
+std::atomic<bool> execute(false);       // ? pipeline.h and buffer.h expect these from the main program
+bool buff_snap = false;
+int batch_size = 1;
+int item_range = 100;
+uint64_t run_seed = 0;
+int failures = 0;                       // ? How many checks failed
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAILED %s:%i: %s\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+/// @name bottleneck_with
+/// @brief Gets the bottleneck of a gen, filter, agg pipeline whose two queues were this full on average
+/// @param first How full the queue after the generator was, from 0 to 1
+/// @param second How full the queue before the aggregator was, from 0 to 1
+/// @return The stage
+int bottleneck_with(double first, double second)
+{
+    std::vector<pipeline_spec> specs = { { STAGE_GENERATE, 1 }, { STAGE_FILTER, 1 }, { STAGE_AGGREGATE, 1 } };
+    pipeline_initialize(specs, ENGINE_MUTEX, 100, WAIT_ADAPTIVE);
+    double fills[2] = { first, second };
+    for (int q = 0; q < 2; ++q)
+    {
+        pipeline_occupancies[q].samples = 1;
+        pipeline_occupancies[q].total = (long)(fills[q] * 100);
+    }
+    return pipeline_bottleneck();
+}
+
+/// @name test_bottleneck
+/// @brief The stage in front of the queues that back up and behind the ones that run dry is the bottleneck, and
+/// @brief the generator isn't picked just for having no input queue
+void test_bottleneck()
+{
+    CHECK(bottleneck_with(0.0, 0.0) == 0);                  // ? Nothing ever waits: the generator is the limit
+    CHECK(bottleneck_with(1.0, 0.0) == 1);
+    CHECK(bottleneck_with(1.0, 1.0) == 2);
+    CHECK(bottleneck_with(0.4, 0.0) == 1);                  // ? The filter falls behind; its output still runs dry
+    CHECK(bottleneck_with(0.1, 0.0) == 0);
+}
+
+int main()
+{
+    test_bottleneck();
+
+    if (failures > 0)
+    {
+        printf("%i check(s) failed\n", failures);
+        return 1;
+    }
+    printf("pipeline: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,107 @@
+// **********************************************************
+// *
+// * Sam Young
+// * Operating Systems
+// * Programming Project 3: Process Synchronization
+// * March 14, 2025
+// * Dr. Siming Liu
+// *
+// **********************************************************
+
+// ? Checks the segmented sieve and Miller-Rabin against trial division. Run with "make test"; exits non-zero on failure.
+
+#include <cstdio>
+#include "prime.h"
+
+int failures = 0;                       // ? How many checks failed
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAILED %s:%i: %s\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+/// @name trial_division
+/// @brief The slow, obviously right answer the fast paths are checked against
+/// @param n The number
+/// @return true if n is prime, false otherwise
+bool trial_division(uint64_t n)
+{
+    if (n < 2) return false;
+    if (n % 2 == 0) return n == 2;
+    for (uint64_t d = 3; d * d <= n; d += 2)
+    {
+        if (n % d == 0) return false;
+    }
+    return true;
+}
+
+/// @name test_sieve
+/// @brief Every number below the sieve's limit agrees with trial division, across several segments and for a limit
+/// @brief that ends partway through a segment
+void test_sieve()
+{
+    for (uint32_t limit : { 10u, 1000003u, 4u * PRIME_SEGMENT_BITS })
+    {
+        prime_initialize(limit);
+        CHECK(prime_limit == limit);
+        int wrong = 0;
+        for (int64_t n = -3; n < (int64_t)limit; ++n)
+        {
+            if (prime_is(n) != trial_division(n < 0 ? 0 : (uint64_t)n)) ++wrong;
+        }
+        CHECK(wrong == 0);
+    }
+}
+
+/// @name test_miller_rabin
+/// @brief Numbers above the sieve agree with trial division, and the known hard cases come out right
+void test_miller_rabin()
+{
+    prime_initialize(1000);
+    int wrong = 0;
+    for (uint64_t n = 1000; n < 200000; ++n)
+    {
+        if (prime_is((int64_t)n) != trial_division(n)) ++wrong;
+    }
+    for (uint64_t n = 2147483647ull - 20000; n <= 2147483647ull; ++n)
+    {
+        if (prime_is((int64_t)n) != trial_division(n)) ++wrong;
+    }
+    CHECK(wrong == 0);
+
+    CHECK(prime_is(2147483647));                            // ? 2^31 - 1
+    CHECK(prime_miller_rabin(2305843009213693951ull));      // ? 2^61 - 1
+    CHECK(prime_miller_rabin(18446744073709551557ull));     // ? The largest 64-bit prime
+    CHECK(!prime_is(561) && !prime_is(41041));              // ? Carmichael numbers
+    CHECK(!prime_miller_rabin(3215031751ull));              // ? A strong pseudoprime to bases 2, 3, 5 and 7
+    CHECK(!prime_miller_rabin(149491ull * 747451ull * 34233211ull));   // ? ... and to every prime base up to 37
+}
+
+/// @name test_count
+/// @brief prime_count agrees with prime_is item by item, inside the sieve, above it and for negative numbers
+void test_count()
+{
+    prime_initialize(100);
+    int64_t items[] = { -7, -1, 0, 1, 2, 3, 4, 97, 99, 101, 7919, 7921, 2147483647 };
+    int n = sizeof(items) / sizeof(items[0]);
+    uint8_t flags[sizeof(items) / sizeof(items[0])];
+
+    int expected = 0;
+    for (int i = 0; i < n; ++i) expected += prime_is(items[i]);
+    CHECK(prime_count(items, n, flags) == expected);
+    CHECK(prime_count(items, n) == expected);
+    for (int i = 0; i < n; ++i) CHECK(flags[i] == (uint8_t)prime_is(items[i]));
+    CHECK(expected == 6);                                   // ? 2, 3, 97, 101, 7919 and 2^31 - 1
+}
+
+int main()
+{
+    test_sieve();
+    test_miller_rabin();
+    test_count();
+
+    if (failures > 0)
+    {
+        printf("%i check(s) failed\n", failures);
+        return 1;
+    }
+    printf("prime: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,240 @@
+// **********************************************************
+// *
+// * Sam Young
+// * Operating Systems
+// * Programming Project 3: Process Synchronization
+// * March 14, 2025
+// * Dr. Siming Liu
+// *
+// **********************************************************
+
+// ? Checks the queue engines and the buffer modes built on them. Run with "make test"; exits non-zero on failure.
+
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include "buffer.h"
+
+bool buff_snap = false;                 // ? buffer.h expects this from the main program
+int failures = 0;                       // ? How many checks failed
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAILED %s:%i: %s\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+const buffer_engine ENGINES[] = { ENGINE_MUTEX, ENGINE_SPSC, ENGINE_MPMC };
+
+/// @name test_move_only
+/// @brief A queue of a move-only type: every way in and out moves the items instead of copying them
+void test_move_only()
+{
+    for (buffer_engine e : ENGINES)
+    {
+        bounded_queue<std::unique_ptr<int>> q(e, 4);
+        CHECK(q.push(std::unique_ptr<int>(new int(1))));
+        CHECK(q.emplace(new int(2)));
+        std::unique_ptr<int> batch[2] = { std::unique_ptr<int>(new int(3)), std::unique_ptr<int>(new int(4)) };
+        CHECK(q.push_n(batch, 2) == 2);
+        CHECK(batch[0] == nullptr && batch[1] == nullptr);
+        CHECK(q.size() == 4);
+
+        std::unique_ptr<int> one;
+        CHECK(q.pop(one) && *one == 1);
+        std::unique_ptr<int> out[3];
+        CHECK(q.pop_n(out, 3) == 3);
+        CHECK(*out[0] == 2 && *out[1] == 3 && *out[2] == 4);
+
+        CHECK(q.push(std::unique_ptr<int>(new int(5))));   // ? Left in the queue, for the destructor to free
+    }
+}
+
+/// @name test_closed
+/// @brief After close(), push and emplace fail, and pop returns what's left before failing
+void test_closed()
+{
+    for (buffer_engine e : ENGINES)
+    {
+        bounded_queue<int> q(e, 4);
+        CHECK(q.push(7));
+        q.close();
+        CHECK(q.closed());
+        CHECK(!q.push(8));
+        CHECK(!q.emplace(9));
+        int items[2] = { 1, 2 };
+        CHECK(q.push_n(items, 2) == 0);
+
+        int out = 0;
+        CHECK(q.pop(out) && out == 7);
+        CHECK(!q.pop(out));
+        CHECK(q.size() == 0);
+        CHECK(q.push(10) == false);                         // ? Still closed, and nothing was left half-claimed
+    }
+}
+
+/// @name run_drain
+/// @brief Runs producers and consumers on the buffer for a moment, then stops the producers, closes the buffer and
+/// @brief lets the consumers drain it. Every thread registers its own stats slot, as the program's threads do.
+/// @param producers How many producer threads
+/// @param consumers How many consumer threads
+/// @param batch Items per buffer call
+/// @return The number of items lost: inserted but never removed (or left in the buffer)
+long run_drain(int producers, int consumers, int batch)
+{
+    std::atomic<bool> running(true);
+    std::atomic<long> inserted(0), removed(0);
+    std::vector<std::thread> prod, cons;
+    stats_initialize(producers, consumers);
+
+    for (int i = 0; i < consumers; ++i)
+    {
+        cons.emplace_back([&, i] {
+            stats_register(producers + i);
+            std::vector<buffer_item> items(batch);
+            long mine = 0;
+            for (int n; (n = buffer_remove_items(items.data(), batch)) > 0; ) mine += n;
+            removed += mine;
+        });
+    }
+    for (int i = 0; i < producers; ++i)
+    {
+        prod.emplace_back([&, i] {
+            stats_register(i);
+            rng_seed(1, i);
+            std::vector<buffer_item> items(batch, i);
+            long mine = 0;
+            while (running.load()) mine += buffer_insert_items(items.data(), batch);
+            inserted += mine;
+        });
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    running = false;
+    for (std::thread& t : prod) t.join();                   // ? Drains: producers first, then close, then consumers
+    buffer_close();
+    for (std::thread& t : cons) t.join();
+
+    return inserted.load() - removed.load() - buffer_count();
+}
+
+/// @name test_drain
+/// @brief Draining loses nothing on any engine, batched or not, with one shared buffer, shards or priority classes
+void test_drain()
+{
+    for (buffer_engine e : ENGINES)
+    {
+        int threads = (e == ENGINE_SPSC) ? 1 : 2;
+        for (int batch : { 1, 8 })
+        {
+            buffer_initialize(e, 16, WAIT_ADAPTIVE);
+            CHECK(run_drain(threads, threads, batch) == 0);
+            CHECK(buffer_count() == 0);
+
+            if (e == ENGINE_SPSC) continue;
+            buffer_initialize(e, 16, WAIT_ADAPTIVE, 2);
+            CHECK(run_drain(threads, threads, batch) == 0);
+            CHECK(buffer_shard_totals[0].inserted.load() > 0);     // ? Producer 1 and producer 2 each filled their own
+            CHECK(buffer_shard_totals[1].inserted.load() > 0);
+
+            buffer_set_classes(false, { 2, 1 }, { 1, 3 });
+            buffer_initialize(e, 16, WAIT_ADAPTIVE, 0, { 4, 16 });
+            CHECK(run_drain(threads, threads, batch) == 0);
+        }
+    }
+    buffer_set_classes(true, {}, {});
+    buffer_initialize(ENGINE_MUTEX, 16, WAIT_ADAPTIVE);     // ? Leaves the buffer out of sharded and priority mode
+}
+
+/// @name test_steal
+/// @brief In sharded mode a producer inserts into its home shard, and a consumer whose home shard is empty steals
+/// @brief from another one
+void test_steal()
+{
+    for (buffer_engine e : { ENGINE_MUTEX, ENGINE_MPMC })
+    {
+        buffer_initialize(e, 16, WAIT_ADAPTIVE, 2);
+        stats_initialize(1, 2);
+
+        std::thread producer([] {
+            stats_register(0);                              // ? Producer 1: home shard 0
+            buffer_item items[4] = { 1, 2, 3, 4 };
+            CHECK(buffer_insert_items(items, 4) == 4);
+        });
+        producer.join();
+        CHECK(buffer_shards[0]->size() == 4 && buffer_shards[1]->size() == 0);
+
+        std::thread consumer([] {
+            stats_register(2);                              // ? Consumer 2: home shard 1, which is empty
+            buffer_item items[4];
+            CHECK(buffer_remove_items(items, 4) == 4);
+        });
+        consumer.join();
+        CHECK(stats_total(&thread_stats::steals) == 1);
+        CHECK(buffer_shard_totals[0].removed.load() == 4);
+    }
+    buffer_initialize(ENGINE_MUTEX, 16, WAIT_ADAPTIVE);
+}
+
+/// @name remove_classes
+/// @brief Removes every item in priority mode, one at a time, and lists the class each came from
+/// @return The classes, in removal order
+std::vector<int> remove_classes()
+{
+    std::vector<int> order;
+    buffer_close();                                         // ? So the last remove returns 0 instead of waiting
+    buffer_item item;
+    int cls;
+    while (buffer_remove_items(&item, 1, &cls) == 1)
+    {
+        CHECK(item == cls);                                 // ? Every item carries its class
+        order.push_back(cls);
+    }
+    return order;
+}
+
+/// @name test_priority
+/// @brief Strict dequeue always takes the most urgent class first; weighted dequeue takes each class's weight in
+/// @brief turn, and moves on as soon as a class runs dry
+void test_priority()
+{
+    for (buffer_engine e : { ENGINE_MUTEX, ENGINE_MPMC })
+    {
+        buffer_set_classes(true, { 1, 1, 1 }, { 1, 1, 1 });
+        buffer_initialize(e, 8, WAIT_ADAPTIVE, 0, { 4, 4, 4 });
+        for (buffer_item c : { 2, 1, 0, 2, 1, 0 })
+        {
+            CHECK(buffer_insert_items(&c, 1, c) == 1);
+        }
+        CHECK(remove_classes() == std::vector<int>({ 0, 0, 1, 1, 2, 2 }));
+
+        buffer_set_classes(false, { 2, 1 }, { 1, 1 });
+        buffer_initialize(e, 8, WAIT_ADAPTIVE, 0, { 8, 8 });
+        buffer_class_turn = 0;
+        buffer_class_served = 0;
+        for (int i = 0; i < 5; ++i)
+        {
+            buffer_item zero = 0, one = 1;
+            CHECK(buffer_insert_items(&zero, 1, 0) == 1);
+            CHECK(buffer_insert_items(&one, 1, 1) == 1);
+        }
+        CHECK(remove_classes() == std::vector<int>({ 0, 0, 1, 0, 0, 1, 0, 1, 1, 1 }));
+    }
+    buffer_set_classes(true, {}, {});
+    buffer_initialize(ENGINE_MUTEX, 16, WAIT_ADAPTIVE);
+}
+
+int main()
+{
+    test_move_only();
+    test_closed();
+    test_drain();
+    test_steal();
+    test_priority();
+
+    if (failures > 0)
+    {
+        printf("%i check(s) failed\n", failures);
+        return 1;
+    }
+    printf("queue: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,124 @@
+// **********************************************************
+// *
+// * Sam Young
+// * Operating Systems
+// * Programming Project 3: Process Synchronization
+// * March 14, 2025
+// * Dr. Siming Liu
+// *
+// **********************************************************
+
+// ? Checks the per-thread xoshiro generators. Run with "make test"; exits non-zero on failure.
+
+#include <cstdio>
+#include <vector>
+#include "rng.h"
+
+int failures = 0;                       // ? How many checks failed
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAILED %s:%i: %s\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+/// @name draw
+/// @brief Seeds the calling thread and draws single values and a batch from it
+/// @param seed The run's seed
+/// @param stream The stream
+/// @return The single values, then the batch
+std::vector<int> draw(uint64_t seed, int stream)
+{
+    rng_seed(seed, stream);
+    std::vector<int> out;
+    for (int i = 0; i < 50; ++i) out.push_back((int)rng_below(1000000));
+    std::vector<int64_t> batch(37);
+    rng_fill(batch.data(), (int)batch.size(), 1000000);
+    out.insert(out.end(), batch.begin(), batch.end());
+    return out;
+}
+
+/// @name test_determinism
+/// @brief The same seed and stream always give the same numbers; another seed or stream gives different ones
+void test_determinism()
+{
+    std::vector<int> a = draw(42, 3);
+    CHECK(draw(42, 3) == a);
+    CHECK(draw(42, 4) != a);
+    CHECK(draw(43, 3) != a);
+}
+
+/// @name test_reference
+/// @brief rng_next is xoshiro256** (checked against the reference implementation's first outputs)
+void test_reference()
+{
+    uint64_t state[4] = { 1, 2, 3, 4 };
+    for (int i = 0; i < 4; ++i) my_rng.s[i] = state[i];
+    CHECK(rng_next() == 11520);
+    CHECK(rng_next() == 0);
+    CHECK(rng_next() == 1509978240);
+    CHECK(rng_next() == 1215971899390074240ull);
+}
+
+/// @name test_batch
+/// @brief rng_fill gives each lane's xoshiro256+ numbers in turn (checked one lane at a time), fills its leftovers
+/// @brief from the single-value stream, and one big batch matches the same numbers drawn in smaller ones
+void test_batch()
+{
+    const uint32_t range = 1000;
+    rng_seed(7, 0);
+    rng_state saved = my_rng;
+
+    int64_t out[4 * 8 + 3];
+    rng_fill(out, 4 * 8 + 3, range);
+
+    for (int l = 0; l < RNG_LANES; ++l)                     // ? Steps each lane on its own, the plain scalar way
+    {
+        uint64_t s[4] = { saved.s0[l], saved.s1[l], saved.s2[l], saved.s3[l] };
+        for (int g = 0; g < 8; ++g)
+        {
+            uint64_t bits = s[0] + s[3];
+            uint64_t t = s[1] << 17;
+            s[2] ^= s[0];
+            s[3] ^= s[1];
+            s[1] ^= s[2];
+            s[0] ^= s[3];
+            s[2] ^= t;
+            s[3] = rng_rotl(s[3], 45);
+            CHECK(out[g * RNG_LANES + l] == (int)(((bits >> 32) * range) >> 32));
+        }
+    }
+
+    my_rng = saved;
+    for (int i = 0; i < 3; ++i) CHECK(out[4 * 8 + i] == (int)rng_below(range));
+
+    int64_t whole[64], halves[64];
+    rng_seed(9, 1);
+    rng_fill(whole, 64, range);
+    rng_seed(9, 1);
+    rng_fill(halves, 32, range);
+    rng_fill(halves + 32, 32, range);
+    bool same = true, in_range = true;
+    for (int i = 0; i < 64; ++i)
+    {
+        same = same && whole[i] == halves[i];
+        in_range = in_range && whole[i] >= 0 && whole[i] < (int)range;
+    }
+    CHECK(same);
+    CHECK(in_range);
+
+    int64_t ones[9];
+    rng_fill(ones, 9, 1);
+    for (int v : ones) CHECK(v == 0);                       // ? A range of one value only ever gives 0
+}
+
+int main()
+{
+    test_determinism();
+    test_reference();
+    test_batch();
+
+    if (failures > 0)
+    {
+        printf("%i check(s) failed\n", failures);
+        return 1;
+    }
+    printf("rng: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,137 @@
+// **********************************************************
+// *
+// * Sam Young
+// * Operating Systems
+// * Programming Project 3: Process Synchronization
+// * March 14, 2025
+// * Dr. Siming Liu
+// *
+// **********************************************************
+
+// ? Checks how the shared-memory ring wraps, closes and drains. Run with "make test"; exits non-zero on failure.
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <initializer_list>
+#include "shm.h"
+
+int failures = 0;                       // ? How many checks failed
+
+#define CHECK(cond) do { if (!(cond)) { printf("FAILED %s:%i: %s\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+/// @name wait_for
+/// @brief Waits up to two seconds for a flag to be set
+/// @param flag The flag
+/// @return true if it was set in time, false otherwise
+bool wait_for(const std::atomic<bool>& flag)
+{
+    for (int i = 0; i < 2000 && !flag.load(); ++i) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return flag.load();
+}
+
+/// @name test_consumer_only_drain
+/// @brief A consumer process that drains stops once the ring is empty, even if no producer process ever attached,
+/// @brief and waits (taking every item) while one still is
+/// @param policy How the consumer waits
+void test_consumer_only_drain(wait_policy policy)
+{
+    std::string name = "/shm_test_" + std::to_string(getpid());
+    std::string error;
+    shm_ring<int>::remove(name.c_str());
+
+    shm_ring<int>* consumer = shm_ring<int>::attach(name.c_str(), 8, policy, false, &error);
+    CHECK(consumer != NULL);
+    if (consumer == NULL) return;
+
+    std::atomic<bool> done(false);
+    int result = -1;
+    std::thread waiter([&] {
+        int item;
+        result = consumer->pop_n(&item, 1);
+        done = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(!done.load());                                    // ? Not draining yet, so an empty ring just waits
+
+    consumer->close();                                      // ? Draining, and no producer is attached
+    CHECK(wait_for(done));
+    if (!done.load()) consumer->stop();
+    waiter.join();
+    CHECK(result == 0);
+
+    shm_ring<int>* producer = shm_ring<int>::attach(name.c_str(), 8, policy, true, &error);
+    CHECK(producer != NULL);
+    if (producer != NULL)
+    {
+        int items[3] = { 1, 2, 3 };
+        CHECK(producer->push_n(items, 3) == 3);
+
+        std::atomic<int> taken(0);
+        done = false;
+        std::thread drainer([&] {
+            int out[8];
+            for (int n; (n = consumer->pop_n(out, 8)) > 0; ) taken += n;
+            done = true;
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        CHECK(!done.load());                                // ? A producer is still attached, so it may insert more
+        CHECK(taken == 3);
+
+        delete producer;                                    // ? The last producer detaches and closes the ring
+        CHECK(wait_for(done));
+        if (!done.load()) consumer->stop();
+        drainer.join();
+        CHECK(taken == 3);
+    }
+
+    delete consumer;
+    shm_ring<int>::remove(name.c_str());
+}
+
+/// @name test_wrap
+/// @brief Items come back in order as the positions wrap around the ring many times, whether the capacity is a power
+/// @brief of two (masked) or not (divided)
+/// @param capacity The ring's capacity
+void test_wrap(int capacity)
+{
+    std::string name = "/shm_test_wrap_" + std::to_string(getpid());
+    std::string error;
+    shm_ring<int>::remove(name.c_str());
+
+    shm_ring<int>* ring = shm_ring<int>::attach(name.c_str(), capacity, WAIT_ADAPTIVE, true, &error);
+    CHECK(ring != NULL);
+    if (ring == NULL) return;
+
+    bool ordered = true;
+    int next = 0, expected = 0;
+    for (int round = 0; round < 4 * capacity; ++round)
+    {
+        int items[3] = { next, next + 1, next + 2 };
+        next += ring->push_n(items, 3);
+        int out[3];
+        int n = ring->pop_n(out, 3);
+        for (int i = 0; i < n; ++i) ordered = ordered && out[i] == expected++;
+    }
+    CHECK(ordered);
+    CHECK(next == 4 * capacity * 3 && expected == next);
+
+    delete ring;
+    shm_ring<int>::remove(name.c_str());
+}
+
+int main()
+{
+    for (wait_policy policy : { WAIT_SPIN, WAIT_ADAPTIVE, WAIT_PARK }) test_consumer_only_drain(policy);
+    test_wrap(5);
+    test_wrap(8);
+
+    if (failures > 0)
+    {
+        printf("%i check(s) failed\n", failures);
+        return 1;
+    }
+    printf("shm: all tests passed\n");
+    return 0;
+}